@@ -0,0 +1,127 @@
+#ifndef INCLUDE_SIPBLOCKXN_H
+#define INCLUDE_SIPBLOCKXN_H
+// siphash outputs of NSIPHASH cuckaroo style edge blocks at once.
+// within a block, the EDGE_BLOCK_SIZE hashes are chained through one siphash state,
+// so lanes run across blocks, each carrying its own state through its block,
+// as in the mean solvers' genUVnodes. the chained outputs are then combined
+// by the xor chaining of the variant.
+
+#include "siphash.hpp"
+
+#ifndef EDGE_BLOCK_BITS
+#define EDGE_BLOCK_BITS 6
+#endif
+#define EDGE_BLOCK_SIZE (1 << EDGE_BLOCK_BITS)
+#define EDGE_BLOCK_MASK (EDGE_BLOCK_SIZE - 1)
+
+#ifndef NSIPHASH
+#define NSIPHASH 1
+#endif
+
+#if NSIPHASH > 1
+#include "siphashxN.h"
+
+#ifdef __AVX2__
+typedef __m256i sipblock_vec;
+#define SIPBLOCK_VECLANES 4
+#define SIPBLOCK_SET1(x) _mm256_set1_epi64x(x)
+#define SIPBLOCK_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SIPBLOCK_STORE(p,x) _mm256_storeu_si256((__m256i *)(p),x)
+#elif defined __SSE2__
+typedef __m128i sipblock_vec;
+#define SIPBLOCK_VECLANES 2
+#define SIPBLOCK_SET1(x) _mm_set1_epi64x(x)
+#define SIPBLOCK_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define SIPBLOCK_STORE(p,x) _mm_storeu_si128((__m128i *)(p),x)
+#else
+#error NSIPHASH > 1 requires sse2 or avx2
+#endif
+
+#if NSIPHASH % SIPBLOCK_VECLANES
+#error NSIPHASH must be a multiple of the vector width
+#endif
+#define SIPBLOCK_NVECS (NSIPHASH / SIPBLOCK_VECLANES)
+
+// one siphash round on all vectors, with rotation rotE of v3
+#define SIPBLOCK_ROUND \
+  for (uint32_t j = 0; j < SIPBLOCK_NVECS; j++) { \
+    v0[j] = ADD(v0[j],v1[j]); v2[j] = ADD(v2[j],v3[j]); v1[j] = ROT13(v1[j]); \
+    v3[j] = ROT16(v3[j]);     v1[j] = XOR(v1[j],v0[j]); v3[j] = XOR(v3[j],v2[j]); \
+    v0[j] = ROT32(v0[j]);     v2[j] = ADD(v2[j],v1[j]); v0[j] = ADD(v0[j],v3[j]); \
+    v1[j] = ROT17(v1[j]);     v3[j] = rotE == 25 ? ROT25(v3[j]) : ROT21(v3[j]); \
+    v1[j] = XOR(v1[j],v2[j]); v3[j] = XOR(v3[j],v0[j]); v2[j] = ROT32(v2[j]); \
+  }
+#endif
+
+// how a variant combines the chained outputs of a block
+enum sipblock_chain {
+  SIPBLOCK_XOR_LAST,   // cuckaroo, cuckarood: all but the last output xored with the last
+  SIPBLOCK_XOR_SUFFIX, // cuckaroom, cuckarooz: every output xored with all later ones
+};
+
+// fills buf with the siphash outputs of the NSIPHASH blocks starting at edge0s[0..NSIPHASH-1],
+// leaving output i of block l in buf[i*NSIPHASH + l]. rotE is 21 or 25 as in siphash_state
+template <int rotE, sipblock_chain chain>
+void sipblockxN(const siphash_keys &keys, const uint64_t *edge0s, uint64_t *buf) {
+  static_assert(rotE == 21 || rotE == 25, "unsupported rotation");
+#if NSIPHASH == 1
+  siphash_state<rotE> shs(keys);
+  for (uint32_t i = 0; i < EDGE_BLOCK_SIZE; i++) {
+    shs.hash24(edge0s[0] + i);
+    buf[i] = shs.xor_lanes();
+  }
+#else
+  sipblock_vec v0[SIPBLOCK_NVECS], v1[SIPBLOCK_NVECS], v2[SIPBLOCK_NVECS], v3[SIPBLOCK_NVECS];
+  sipblock_vec packet[SIPBLOCK_NVECS];
+  const sipblock_vec packetinc = SIPBLOCK_SET1(1);
+  const sipblock_vec ff = SIPBLOCK_SET1(0xffLL);
+  for (uint32_t j = 0; j < SIPBLOCK_NVECS; j++) {
+    v0[j] = SIPBLOCK_SET1(keys.k0);
+    v1[j] = SIPBLOCK_SET1(keys.k1);
+    v2[j] = SIPBLOCK_SET1(keys.k2);
+    v3[j] = SIPBLOCK_SET1(keys.k3);
+    packet[j] = SIPBLOCK_LOAD(edge0s + j * SIPBLOCK_VECLANES);
+  }
+  for (uint32_t i = 0; i < EDGE_BLOCK_SIZE; i++) {
+    for (uint32_t j = 0; j < SIPBLOCK_NVECS; j++)
+      v3[j] = XOR(v3[j],packet[j]);
+    SIPBLOCK_ROUND; SIPBLOCK_ROUND;
+    for (uint32_t j = 0; j < SIPBLOCK_NVECS; j++) {
+      v0[j] = XOR(v0[j],packet[j]);
+      v2[j] = XOR(v2[j],ff);
+    }
+    SIPBLOCK_ROUND; SIPBLOCK_ROUND; SIPBLOCK_ROUND; SIPBLOCK_ROUND;
+    for (uint32_t j = 0; j < SIPBLOCK_NVECS; j++) {
+      SIPBLOCK_STORE(buf + i * NSIPHASH + j * SIPBLOCK_VECLANES, XOR(XOR(v0[j],v1[j]),XOR(v2[j],v3[j])));
+      packet[j] = ADD(packet[j], packetinc);
+    }
+  }
+#endif
+  uint64_t *const last = buf + EDGE_BLOCK_MASK * NSIPHASH;
+  if (chain == SIPBLOCK_XOR_LAST) {
+    for (uint32_t i = 0; i < EDGE_BLOCK_MASK; i++)
+      for (uint32_t l = 0; l < NSIPHASH; l++)
+        buf[i * NSIPHASH + l] ^= last[l];
+  } else {
+    for (uint32_t i = EDGE_BLOCK_MASK; i; i--)
+      for (uint32_t l = 0; l < NSIPHASH; l++)
+        buf[(i-1) * NSIPHASH + l] ^= buf[i * NSIPHASH + l];
+  }
+}
+
+// siphash outputs hashes[0..nedges-1] of edges[0..nedges-1], computing the blocks
+// containing them NSIPHASH at a time
+template <int rotE, sipblock_chain chain, typename edge_t>
+void sipedgesxN(const siphash_keys &keys, const edge_t *edges, const uint32_t nedges, uint64_t *hashes) {
+  alignas(64) uint64_t edge0s[NSIPHASH];
+  alignas(64) uint64_t buf[NSIPHASH * EDGE_BLOCK_SIZE];
+  for (uint32_t n = 0; n < nedges; n += NSIPHASH) {
+    for (uint32_t l = 0; l < NSIPHASH; l++) // pad last group with its final edge
+      edge0s[l] = (uint64_t)edges[n + l < nedges ? n + l : nedges - 1] & ~(uint64_t)EDGE_BLOCK_MASK;
+    sipblockxN<rotE, chain>(keys, edge0s, buf);
+    for (uint32_t l = 0; l < NSIPHASH && n + l < nedges; l++)
+      hashes[n + l] = buf[(edges[n + l] & EDGE_BLOCK_MASK) * NSIPHASH + l];
+  }
+}
+
+#endif // ifdef INCLUDE_SIPBLOCKXN_H
@@ -0,0 +1,197 @@
+// micro-benchmark of siphash kernels in isolation: the siphash24xN kernel selected
+// at compile time by NSIPHASH and the instruction set, and with NSIPHASH 1 also
+// scalar siphash24, cuckaroo style sipblock and the cuckarood rotation variant,
+// and the run-time dispatched kernels, and with larger NSIPHASH the lane-parallel
+// sipblockxN of both rotations. reports ns/hash and hashes per (rdtsc)
+// cycle over repeated runs after warmup, pinned to one cpu, as text or json
+
+#include "siphash.hpp"
+#include "siphashxN.h"
+#include "sipblockxN.h"
+#include "siphashdispatch.h"
+#include "../threads/affinity.hpp"
+#include <x86intrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if NSIPHASH == 1
+#define ISA "scalar"
+#elif defined __AVX2__
+#define ISA "avx2"
+#elif defined __SSE2__
+#define ISA "sse2"
+#endif
+
+// most hashes per kernel call
+#define MAXLANES (NSIPHASH * EDGE_BLOCK_SIZE)
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// as in cuckaroo.hpp, and cuckarood.hpp with rotE 25: EDGE_BLOCK_SIZE chained
+// siphash outputs for the block starting at indices[0]
+template <int rotE>
+void sipblock(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  siphash_state<rotE> shs(*keys);
+  for (uint32_t i = 0; i < EDGE_BLOCK_SIZE; i++) {
+    shs.hash24(indices[0] + i);
+    hashes[i] = shs.xor_lanes();
+  }
+  const uint64_t last = hashes[EDGE_BLOCK_MASK];
+  for (uint32_t i = 0; i < EDGE_BLOCK_MASK; i++)
+    hashes[i] ^= last;
+}
+
+// NSIPHASH blocks at once, as the cuckaroo family's sipblockN
+template <int rotE>
+void sipblocks(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  sipblockxN<rotE, SIPBLOCK_XOR_LAST>(*keys, indices, hashes);
+}
+
+void siphash24x1(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  *hashes = keys->siphash24(*indices);
+}
+
+struct bench_params {
+  uint64_t nhashes; // per run
+  uint32_t nruns;
+  uint32_t nwarmups;
+};
+
+struct bench_result {
+  const char *name;
+  const char *isa;
+  uint32_t nlanes;
+  double nsmin, nsmedian, nsmean, nsstddev; // ns per hash
+  double hpc;                               // hashes per cycle in median run
+};
+
+// time one run of nhashes hashes by kernel f of nlanes lanes, in ns and rdtsc cycles
+template <void (*F)(const siphash_keys *, const uint64_t *, uint64_t *)>
+void timerun(const uint32_t nlanes, const uint64_t nhashes, double &ns, double &cycles) {
+  siphash_keys keys = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL, 0x1716151413121110ULL, 0x1f1e1d1c1b1a1918ULL };
+  alignas(64) uint64_t indices[MAXLANES];
+  alignas(64) uint64_t hashes[MAXLANES];
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < nlanes; i++)
+    indices[i] = 2 * i;
+  using namespace std::chrono;
+  const steady_clock::time_point time0 = steady_clock::now();
+  const uint64_t rdtsc0 = __rdtsc();
+  for (uint64_t n = 0; n < nhashes; n += nlanes) {
+    F(&keys, indices, hashes);
+    for (uint32_t i = 0; i < nlanes; i++) {
+      sum ^= hashes[i];
+      indices[i] += 2 * nlanes;
+    }
+  }
+  cycles = __rdtsc() - rdtsc0;
+  ns = duration_cast<nanoseconds>(steady_clock::now() - time0).count();
+  if (sum == 0x5eed) // keep the hashes alive
+    printf("!");
+}
+
+template <void (*F)(const siphash_keys *, const uint64_t *, uint64_t *)>
+bench_result bench(const char *name, const char *isa, const uint32_t nlanes, const bench_params &bp) {
+  double ns, cycles;
+  for (uint32_t r = 0; r < bp.nwarmups; r++)
+    timerun<F>(nlanes, bp.nhashes, ns, cycles);
+  std::vector<std::pair<double,double> > runs; // ns/hash, cycles
+  for (uint32_t r = 0; r < bp.nruns; r++) {
+    timerun<F>(nlanes, bp.nhashes, ns, cycles);
+    runs.push_back(std::make_pair(ns / bp.nhashes, cycles));
+  }
+  std::sort(runs.begin(), runs.end());
+  bench_result res;
+  res.name = name;
+  res.isa = isa;
+  res.nlanes = nlanes;
+  res.nsmin = runs[0].first;
+  res.nsmedian = runs[bp.nruns/2].first;
+  res.hpc = bp.nhashes / runs[bp.nruns/2].second;
+  double sum = 0, sumsq = 0;
+  for (uint32_t r = 0; r < bp.nruns; r++) {
+    sum += runs[r].first;
+    sumsq += runs[r].first * runs[r].first;
+  }
+  res.nsmean = sum / bp.nruns;
+  res.nsstddev = sqrt(std::max(0.0, sumsq / bp.nruns - res.nsmean * res.nsmean));
+  return res;
+}
+
+// run-time dispatched kernels, which can't be template arguments
+const siphash_kernel *dispatched;
+void dispatchedkernel(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  dispatched->hash(keys, indices, hashes);
+}
+
+int main(int argc, char **argv) {
+  bench_params bp = { 1 << 22, 10, 2 };
+  int cpu = 0;
+  bool json = false;
+  int c;
+  while ((c = getopt (argc, argv, "c:jn:r:w:")) != -1) {
+    switch (c) {
+      case 'c':
+        cpu = atoi(optarg);
+        break;
+      case 'j':
+        json = true;
+        break;
+      case 'n':
+        bp.nhashes = atoll(optarg);
+        break;
+      case 'r':
+        bp.nruns = atoi(optarg);
+        break;
+      case 'w':
+        bp.nwarmups = atoi(optarg);
+        break;
+    }
+  }
+  if (bp.nruns < 1 || bp.nhashes < MAXLANES) {
+    fprintf(stderr, "need at least 1 run of %d hashes\n", MAXLANES);
+    exit(1);
+  }
+  bp.nhashes -= bp.nhashes % MAXLANES; // whole calls for every kernel
+  const bool pinned = cpu >= 0 && pin_thread(cpu);
+
+  std::vector<bench_result> results;
+#if NSIPHASH == 1
+  results.push_back(bench<siphash24x1>("siphash24", ISA, 1, bp));
+  results.push_back(bench<sipblock<21> >("sipblock", ISA, EDGE_BLOCK_SIZE, bp));
+  results.push_back(bench<sipblock<25> >("sipblock25", ISA, EDGE_BLOCK_SIZE, bp));
+  for (uint32_t i = 0; i < NSIPHASH_KERNELS; i++) {
+    dispatched = &siphash_kernels[i];
+    if (siphash_supported(dispatched))
+      results.push_back(bench<dispatchedkernel>(dispatched->name, "dispatch", dispatched->nlanes, bp));
+  }
+#else
+  results.push_back(bench<siphash24xN>("siphash24x" STR(NSIPHASH), ISA, NSIPHASH, bp));
+  results.push_back(bench<sipblocks<21> >("sipblockx" STR(NSIPHASH), ISA, MAXLANES, bp));
+  results.push_back(bench<sipblocks<25> >("sipblock25x" STR(NSIPHASH), ISA, MAXLANES, bp));
+#endif
+
+  if (json) {
+    printf("{\"nsiphash\": %d, \"cpu\": %d, \"pinned\": %s, \"nhashes\": %llu, \"runs\": %d, \"warmups\": %d, \"results\": [",
+           NSIPHASH, cpu, pinned ? "true" : "false", (unsigned long long)bp.nhashes, bp.nruns, bp.nwarmups);
+    for (uint32_t i = 0; i < results.size(); i++) {
+      const bench_result &r = results[i];
+      printf("%s\n  {\"kernel\": \"%s\", \"isa\": \"%s\", \"lanes\": %d, \"ns_per_hash\": {\"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, \"stddev\": %.4f}, \"hashes_per_cycle\": %.4f}",
+             i ? "," : "", r.name, r.isa, r.nlanes, r.nsmin, r.nsmedian, r.nsmean, r.nsstddev, r.hpc);
+    }
+    printf("\n]}\n");
+  } else {
+    for (uint32_t i = 0; i < results.size(); i++) {
+      const bench_result &r = results[i];
+      printf("%-12s %-8s %2d lanes %7.3f ns/hash (min %.3f stddev %.3f) %.3f hashes/cycle\n",
+             r.name, r.isa, r.nlanes, r.nsmedian, r.nsmin, r.nsstddev, r.hpc);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+#ifndef INCLUDE_SIPHASHDISPATCH_H
+#define INCLUDE_SIPHASHDISPATCH_H
+// run-time selection of a siphash24xN kernel, independent of -m flags and NSIPHASH:
+// every kernel is compiled for its own instruction set with target attributes,
+// and the widest one the cpu supports is bound at startup.
+// kernels use the standard siphash-2-4 rotations, i.e. ROT_E 21.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "siphash.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIPHASH_DISPATCH_X86
+#endif
+
+typedef void (*siphash24xN_fn)(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes);
+
+struct siphash_kernel {
+  const char *name;
+  const char *cpufeature; // needed to run, as known to __builtin_cpu_supports, or 0
+  uint32_t nlanes;        // number of hashes per call
+  siphash24xN_fn hash;
+};
+
+// most lanes of any kernel, for sizing index and hash buffers
+#define SIPHASH_MAXLANES 16
+
+// portable fallbacks, leaving instruction scheduling to the compiler
+void siphash24x1_portable(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  *hashes = keys->siphash24(*indices);
+}
+
+void siphash24x4_portable(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  siphash_state<> v[4] = { *keys, *keys, *keys, *keys };
+  for (int i = 0; i < 4; i++) v[i].v3 ^= indices[i];
+  for (int i = 0; i < 4; i++) { v[i].sip_round(); v[i].sip_round(); }
+  for (int i = 0; i < 4; i++) { v[i].v0 ^= indices[i]; v[i].v2 ^= 0xff; }
+  for (int r = 0; r < 4; r++)
+    for (int i = 0; i < 4; i++) v[i].sip_round();
+  for (int i = 0; i < 4; i++) hashes[i] = v[i].xor_lanes();
+}
+
+#ifdef SIPHASH_DISPATCH_X86
+
+// a siphash round on two interleaved vectors of lanes,
+// with the vector operations of instruction set I
+#define SIPROUND2V(I) \
+  do { \
+    v0 = ADD_##I(v0,v1); v4 = ADD_##I(v4,v5); \
+    v2 = ADD_##I(v2,v3); v6 = ADD_##I(v6,v7); \
+    v1 = ROT_##I(v1,13); v5 = ROT_##I(v5,13); \
+    v3 = ROT16_##I(v3);  v7 = ROT16_##I(v7); \
+    v1 = XOR_##I(v1,v0); v5 = XOR_##I(v5,v4); \
+    v3 = XOR_##I(v3,v2); v7 = XOR_##I(v7,v6); \
+    v0 = ROT32_##I(v0);  v4 = ROT32_##I(v4); \
+    v2 = ADD_##I(v2,v1); v6 = ADD_##I(v6,v5); \
+    v0 = ADD_##I(v0,v3); v4 = ADD_##I(v4,v7); \
+    v1 = ROT_##I(v1,17); v5 = ROT_##I(v5,17); \
+    v3 = ROT_##I(v3,21); v7 = ROT_##I(v7,21); \
+    v1 = XOR_##I(v1,v2); v5 = XOR_##I(v5,v6); \
+    v3 = XOR_##I(v3,v0); v7 = XOR_##I(v7,v4); \
+    v2 = ROT32_##I(v2);  v6 = ROT32_##I(v6); \
+  } while(0)
+
+// sipHash-2-4 of 2*W indices as two vectors of W lanes
+#define SIPHASH24X2V(I, W) \
+  do { \
+    const VEC_##I packet0 = LOAD_##I(indices); \
+    const VEC_##I packet1 = LOAD_##I(indices+W); \
+    VEC_##I v0, v1, v2, v3, v4, v5, v6, v7; \
+    v4 = v0 = SET1_##I(keys->k0); \
+    v5 = v1 = SET1_##I(keys->k1); \
+    v6 = v2 = SET1_##I(keys->k2); \
+    v7 = v3 = SET1_##I(keys->k3); \
+    v3 = XOR_##I(v3,packet0); v7 = XOR_##I(v7,packet1); \
+    SIPROUND2V(I); SIPROUND2V(I); \
+    v0 = XOR_##I(v0,packet0); v4 = XOR_##I(v4,packet1); \
+    v2 = XOR_##I(v2,SET1_##I(0xffLL)); v6 = XOR_##I(v6,SET1_##I(0xffLL)); \
+    SIPROUND2V(I); SIPROUND2V(I); SIPROUND2V(I); SIPROUND2V(I); \
+    STORE_##I(hashes,   XOR_##I(XOR_##I(v0,v1),XOR_##I(v2,v3))); \
+    STORE_##I(hashes+W, XOR_##I(XOR_##I(v4,v5),XOR_##I(v6,v7))); \
+  } while(0)
+
+#define VEC_sse2 __m128i
+#define LOAD_sse2(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE_sse2(p,x) _mm_storeu_si128((__m128i *)(p),x)
+#define SET1_sse2(x) _mm_set1_epi64x(x)
+#define ADD_sse2(a,b) _mm_add_epi64(a,b)
+#define XOR_sse2(a,b) _mm_xor_si128(a,b)
+#define ROT_sse2(x,b) _mm_or_si128(_mm_slli_epi64(x,b),_mm_srli_epi64(x,64-(b)))
+#define ROT16_sse2(x) _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2,1,0,3)), _MM_SHUFFLE(2,1,0,3))
+#define ROT32_sse2(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(2,3,0,1))
+
+#define VEC_avx2 __m256i
+#define LOAD_avx2(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE_avx2(p,x) _mm256_storeu_si256((__m256i *)(p),x)
+#define SET1_avx2(x) _mm256_set1_epi64x(x)
+#define ADD_avx2(a,b) _mm256_add_epi64(a,b)
+#define XOR_avx2(a,b) _mm256_xor_si256(a,b)
+#define ROT_avx2(x,b) _mm256_or_si256(_mm256_slli_epi64(x,b),_mm256_srli_epi64(x,64-(b)))
+#define ROT16_avx2(x) _mm256_shuffle_epi8(x, _mm256_set_epi64x(0x0D0C0B0A09080F0EULL,0x0504030201000706ULL, \
+                                                               0x0D0C0B0A09080F0EULL,0x0504030201000706ULL))
+#define ROT32_avx2(x) _mm256_shuffle_epi32(x, _MM_SHUFFLE(2,3,0,1))
+
+// avx512 has native 64-bit rotates (vprolq)
+#define VEC_avx512 __m512i
+#define LOAD_avx512(p) _mm512_loadu_si512((const void *)(p))
+#define STORE_avx512(p,x) _mm512_storeu_si512((void *)(p),x)
+#define SET1_avx512(x) _mm512_set1_epi64(x)
+#define ADD_avx512(a,b) _mm512_add_epi64(a,b)
+#define XOR_avx512(a,b) _mm512_xor_si512(a,b)
+#define ROT_avx512(x,b) _mm512_rol_epi64(x,b)
+#define ROT16_avx512(x) _mm512_rol_epi64(x,16)
+#define ROT32_avx512(x) _mm512_rol_epi64(x,32)
+
+__attribute__((target("sse2")))
+void siphash24x4_sse2(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  SIPHASH24X2V(sse2, 2);
+}
+
+__attribute__((target("avx2")))
+void siphash24x8_avx2(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  SIPHASH24X2V(avx2, 4);
+}
+
+// gcc flags the deliberately undefined pass-through operand of _mm512_rol_epi64
+// as uninitialized when avx512 is enabled by target attribute only
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+__attribute__((target("avx512f")))
+void siphash24x16_avx512(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  SIPHASH24X2V(avx512, 8);
+}
+#pragma GCC diagnostic pop
+
+#endif // SIPHASH_DISPATCH_X86
+
+// all kernels, narrowest first
+const siphash_kernel siphash_kernels[] = {
+  { "x1", 0, 1, siphash24x1_portable },
+  { "x4", 0, 4, siphash24x4_portable },
+#ifdef SIPHASH_DISPATCH_X86
+  { "x4sse2", "sse2", 4, siphash24x4_sse2 },
+  { "x8avx2", "avx2", 8, siphash24x8_avx2 },
+  { "x16avx512", "avx512f", 16, siphash24x16_avx512 },
+#endif
+};
+const uint32_t NSIPHASH_KERNELS = sizeof(siphash_kernels) / sizeof(siphash_kernels[0]);
+
+// whether the cpu can run kernel k
+bool siphash_supported(const siphash_kernel *k) {
+  if (!k->cpufeature)
+    return true;
+#ifdef SIPHASH_DISPATCH_X86
+  __builtin_cpu_init();
+  // __builtin_cpu_supports only takes string literals
+  if (!strcmp(k->cpufeature, "sse2"))
+    return __builtin_cpu_supports("sse2");
+  if (!strcmp(k->cpufeature, "avx2"))
+    return __builtin_cpu_supports("avx2");
+  if (!strcmp(k->cpufeature, "avx512f"))
+    return __builtin_cpu_supports("avx512f");
+#endif
+  return false;
+}
+
+// the widest kernel the cpu supports, or the one named by
+// environment variable SIPHASH_KERNEL if that is supported
+const siphash_kernel *siphash_select() {
+  const char *name = getenv("SIPHASH_KERNEL");
+  const siphash_kernel *best = &siphash_kernels[0];
+  for (uint32_t i = 0; i < NSIPHASH_KERNELS; i++) {
+    const siphash_kernel *k = &siphash_kernels[i];
+    if (!siphash_supported(k))
+      continue;
+    if (name && !strcmp(name, k->name))
+      return k;
+    if (k->nlanes >= best->nlanes)
+      best = k;
+  }
+  return best;
+}
+
+const siphash_kernel *siphash_dispatch = siphash_select();
+
+#endif // ifdef INCLUDE_SIPHASHDISPATCH_H
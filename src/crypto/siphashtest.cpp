@@ -0,0 +1,60 @@
+// check every siphash24xN kernel this cpu supports against siphash_keys::siphash24
+// exits with status 1 on the first mismatch
+
+#include "siphashdispatch.h"
+#include "siphashxN.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// number of random keys and index batches to try
+#define NKEYS 64
+#define NBATCHES 256
+
+// simple deterministic generator for keys and indices
+uint64_t xorshift(uint64_t &x) {
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  return x;
+}
+
+// compare nlanes hashes from f against scalar siphash24 with rotation rotE,
+// or report the first difference
+template <int rotE>
+bool check(const char *name, siphash24xN_fn f, const uint32_t nlanes) {
+  alignas(64) uint64_t indices[SIPHASH_MAXLANES];
+  alignas(64) uint64_t hashes[SIPHASH_MAXLANES];
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  siphash_keys keys;
+  for (uint32_t k = 0; k < NKEYS; k++) {
+    keys.k0 = xorshift(x); keys.k1 = xorshift(x); keys.k2 = xorshift(x); keys.k3 = xorshift(x);
+    for (uint32_t b = 0; b < NBATCHES; b++) {
+      for (uint32_t i = 0; i < nlanes; i++)
+        indices[i] = b == 0 ? i : b == 1 ? ~(uint64_t)i : xorshift(x); // include extreme indices
+      f(&keys, indices, hashes);
+      for (uint32_t i = 0; i < nlanes; i++) {
+        siphash_state<rotE> ref(keys);
+        ref.hash24(indices[i]);
+        if (hashes[i] != ref.xor_lanes()) {
+          printf("%-10s FAILED: key %d index %llx lane %d hash %llx instead of %llx\n", name, k,
+                 indices[i], i, hashes[i], ref.xor_lanes());
+          return false;
+        }
+      }
+    }
+  }
+  printf("%-10s OK\n", name);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  for (uint32_t i = 0; i < NSIPHASH_KERNELS; i++) {
+    const siphash_kernel *k = &siphash_kernels[i];
+    if (siphash_supported(k))
+      ok &= check<21>(k->name, k->hash, k->nlanes);
+    else printf("%-10s skipped; needs %s\n", k->name, k->cpufeature);
+  }
+  // the kernels selected at compile time by NSIPHASH, with rotation ROT_E
+  ok &= check<ROT_E_BITS>("xN", siphash24xN, NSIPHASH);
+  printf("dispatch selects %s\n", siphash_dispatch->name);
+  return ok ? 0 : 1;
+}
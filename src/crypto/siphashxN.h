@@ -34,6 +34,14 @@
 #define ROT_E ROT21
 #endif
 
+// ROT_E as a rotation count, for the scalar siphash_state lanes
+#define ROT21_BITS 21
+#define ROT23_BITS 23
+#define ROT25_BITS 25
+#define ROT_BITS_(r) r##_BITS
+#define ROT_BITS(r) ROT_BITS_(r)
+#define ROT_E_BITS ROT_BITS(ROT_E)
+
 #define SIPROUNDXN \
   do { \
     v0 = ADD(v0,v1); v2 = ADD(v2,v3); v1 = ROT13(v1); \
@@ -191,13 +199,61 @@ void siphash24x4(const siphash_keys *keys, const uint64_t *indices, uint64_t *ha
   _mm_store_si128((__m128i *)hashes,		mi);
   _mm_store_si128((__m128i *)(hashes + 2),m2);
 }
+
+// siphash round on vector state a0..a3
+#define SIPROUNDV(a0,a1,a2,a3) \
+  do { \
+    a0 = ADD(a0,a1); a2 = ADD(a2,a3); a1 = ROT13(a1); \
+    a3 = ROT16(a3);  a1 = XOR(a1,a0); a3 = XOR(a3,a2); \
+    a0 = ROT32(a0);  a2 = ADD(a2,a1); a0 = ADD(a0,a3); \
+    a1 = ROT17(a1);                   a3 = ROT_E(a3); \
+    a1 = XOR(a1,a2); a3 = XOR(a3,a0); a2 = ROT32(a2); \
+  } while(0)
+
+// three 2-lane vectors and two scalar lanes, whose independent dependency chains
+// keep both the vector units and the integer alus busy
+#define SIPROUNDX8M \
+  do { \
+    SIPROUNDX2N; SIPROUNDV(v8,v9,vA,vB); s.sip_round(); t.sip_round(); \
+  } while(0)
+
+// 8-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
+// for cpus without avx2, as 6 sse2 lanes interleaved with 2 scalar lanes
+void siphash24x8(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  __m128i v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, vA, vB;
+  const __m128i m0 = _mm_load_si128((__m128i *)indices);
+  const __m128i m2 = _mm_load_si128((__m128i *)(indices + 2));
+  const __m128i m4 = _mm_load_si128((__m128i *)(indices + 4));
+  siphash_state<ROT_E_BITS> s(*keys), t(*keys);
+  v8 = v4 = v0 = _mm_set1_epi64x(keys->k0);
+  v9 = v5 = v1 = _mm_set1_epi64x(keys->k1);
+  vA = v6 = v2 = _mm_set1_epi64x(keys->k2);
+  vB = v7 = v3 = _mm_set1_epi64x(keys->k3);
+
+  v3 = XOR(v3,m0); v7 = XOR(v7,m2); vB = XOR(vB,m4);
+  s.v3 ^= indices[6]; t.v3 ^= indices[7];
+  SIPROUNDX8M; SIPROUNDX8M;
+  v0 = XOR(v0,m0); v4 = XOR(v4,m2); v8 = XOR(v8,m4);
+  s.v0 ^= indices[6]; t.v0 ^= indices[7];
+  v2 = XOR(v2,_mm_set1_epi64x(0xffLL));
+  v6 = XOR(v6,_mm_set1_epi64x(0xffLL));
+  vA = XOR(vA,_mm_set1_epi64x(0xffLL));
+  s.v2 ^= 0xff; t.v2 ^= 0xff;
+  SIPROUNDX8M; SIPROUNDX8M; SIPROUNDX8M; SIPROUNDX8M;
+  _mm_store_si128((__m128i *) hashes     , XOR(XOR(v0,v1),XOR(v2,v3)));
+  _mm_store_si128((__m128i *)(hashes + 2), XOR(XOR(v4,v5),XOR(v6,v7)));
+  _mm_store_si128((__m128i *)(hashes + 4), XOR(XOR(v8,v9),XOR(vA,vB)));
+  hashes[6] = s.xor_lanes();
+  hashes[7] = t.xor_lanes();
+}
 #endif
 
 #ifndef NSIPHASH
 // how many siphash24 to compute in parallel
-// currently 1, 2, 4, 8 are supported, but
+// currently 1, 2, 4, 8, 16 are supported, but
 // more than 1 requires the use of sse2 or avx2
-// more than 4 requires the use of avx2
+// 8 without avx2 mixes sse2 and scalar lanes
+// 16 requires the use of avx2
 #define NSIPHASH 1
 #endif
 
@@ -9,6 +9,7 @@
 #include <ctime>
 #include "../crypto/blake2.h"
 #include "../crypto/siphash.hpp"
+#include "../crypto/sipblockxN.h"
 
 // save some keystrokes since i'm a lazy typer
 typedef uint32_t u32;
@@ -131,10 +132,16 @@ u64 sipblock(siphash_keys &keys, const word_t edge, u64 *buf) {
   return buf[edge & EDGE_BLOCK_MASK];
 }
 
+// fills buffer with siphash outputs for the NSIPHASH blocks starting at edge0s,
+// output i of block l in buf[i*NSIPHASH + l]
+void sipblockN(const siphash_keys &keys, const u64 *edge0s, u64 *buf) {
+  sipblockxN<21, SIPBLOCK_XOR_LAST>(keys, edge0s, buf);
+}
+
 // verify that edges are ascending and form a cycle in header-generated graph
 int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
   word_t xor0 = 0, xor1 = 0;
-  u64 sips[EDGE_BLOCK_SIZE];
+  u64 sips[PROOFSIZE];
   word_t uvs[2*PROOFSIZE];
 
   for (u32 n = 0; n < PROOFSIZE; n++) {
@@ -142,7 +149,10 @@ int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
       return POW_TOO_BIG;
     if (n && edges[n] <= edges[n-1])
       return POW_TOO_SMALL;
-    u64 edge = sipblock(keys, edges[n], sips);
+  }
+  sipedgesxN<21, SIPBLOCK_XOR_LAST>(keys, edges, PROOFSIZE, sips);
+  for (u32 n = 0; n < PROOFSIZE; n++) {
+    const u64 edge = sips[n];
     xor0 ^= uvs[2*n  ] = edge & EDGEMASK;
     xor1 ^= uvs[2*n+1] = (edge >> 32) & EDGEMASK;
   }
@@ -9,6 +9,8 @@
 #include <ctime>
 #include "../crypto/blake2.h"
 #include "../crypto/siphash.hpp"
+#define ROT_E ROT25 // for siphashxN.h
+#include "../crypto/sipblockxN.h"
 
 // save some keystrokes since i'm a lazy typer
 typedef uint32_t u32;
@@ -132,10 +134,16 @@ u64 sipblock(siphash_keys &keys, const word_t edge, u64 *buf) {
   return buf[edge & EDGE_BLOCK_MASK];
 }
 
+// fills buffer with siphash outputs for the NSIPHASH blocks starting at edge0s,
+// output i of block l in buf[i*NSIPHASH + l]
+void sipblockN(const siphash_keys &keys, const u64 *edge0s, u64 *buf) {
+  sipblockxN<25, SIPBLOCK_XOR_LAST>(keys, edge0s, buf);
+}
+
 // verify that edges are ascending and form a cycle in header-generated graph
 int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
   word_t xor0 = 0, xor1 = 0;
-  u64 sips[EDGE_BLOCK_SIZE];
+  u64 sips[PROOFSIZE];
   word_t uvs[2*PROOFSIZE];
   u32 ndir[2] = { 0, 0 };
 
@@ -147,7 +155,13 @@ int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
       return POW_TOO_BIG;
     if (n && edges[n] <= edges[n-1])
       return POW_TOO_SMALL;
-    u64 edge = sipblock(keys, edges[n], sips);
+    ndir[dir]++;
+  }
+  sipedgesxN<25, SIPBLOCK_XOR_LAST>(keys, edges, PROOFSIZE, sips);
+  ndir[0] = ndir[1] = 0;
+  for (u32 n = 0; n < PROOFSIZE; n++) {
+    const u32 dir = edges[n] & 1;
+    const u64 edge = sips[n];
     xor0 ^= uvs[4 * ndir[dir] + 2 * dir    ] =  edge        & NODE1MASK;
     xor1 ^= uvs[4 * ndir[dir] + 2 * dir + 1] = (edge >> 32) & NODE1MASK;
     ndir[dir]++;
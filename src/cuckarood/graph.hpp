@@ -31,6 +31,7 @@ public:
   u32 MAXSOLS;
   proof *sols;
   u32 nsols;
+  proof path; // of the cycle search of add_edge
 
   graph(word_t maxedges, word_t maxnodes, u32 maxsols, u32 compressbits) : visited(2*maxnodes) {
     MAXEDGES = maxedges;
@@ -41,7 +42,7 @@ public:
     compressu = compressbits ? new compressor<word_t>(EDGEBITS, compressbits) : 0;
     compressv = compressbits ? new compressor<word_t>(EDGEBITS, compressbits) : 0;
     sharedmem = false;
-    sols    = new proof[MAXSOLS+1]; // extra one for current path
+    sols    = new proof[MAXSOLS];
     visited.clear();
   }
 
@@ -62,7 +63,7 @@ public:
     compressu = compressbits ? new compressor<word_t>(EDGEBITS, compressbits, bytes += sizeof(link[MAXEDGES])) : 0;
     compressv = compressbits ? new compressor<word_t>(EDGEBITS, compressbits, bytes + compressu->bytes()) : 0;
     sharedmem = true;
-    sols    = new  proof[MAXSOLS+1];
+    sols    = new proof[MAXSOLS];
     visited.clear();
   }
 
@@ -89,27 +90,49 @@ public:
     return *(word_t *)a - *(word_t *)b;
   }
 
-  void cycles_with_link(u32 len, word_t u, word_t dest) {
-    if (visited.test(u))
-      return;
-    if (u == dest) {
-      print_log("  %d-cycle found\n", len);
-      if (len == PROOFSIZE && nsols < MAXSOLS) {
-        qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
-        memcpy(sols[nsols], sols[nsols-1], sizeof(sols[0]));
+  // depth first search for all paths of at most PROOFSIZE edges that extend
+  // edge path[0] from node u to node dest, reporting each cycle so closed in
+  // the order of a recursive search. the search keeps its own stack of
+  // adjacency list positions, and follows the last edge of a path only to
+  // check whether it reaches dest
+  void cycles_with_link(word_t u, const word_t dest) {
+    word_t nodes[PROOFSIZE]; // on the path, by length of the path up to them
+    word_t next[PROOFSIZE];  // next link to follow from there
+    u32 top = 0;             // deepest node with links to follow
+    for (u32 len = 1; ; ) {  // at node u with a path of len edges
+      if (!visited.test(u)) {
+        if (u == dest)
+          foundcycle(len);
+        else if (len == PROOFSIZE - 1) {
+          for (word_t au1 = adjlist[u]; au1 != NIL; au1 = links[au1].next) {
+            if (links[au1].to == dest) {
+              path[len] = au1;
+              foundcycle(PROOFSIZE);
+            }
+          }
+        } else if ((next[len] = adjlist[u]) != NIL) {
+          visited.set(u);
+          nodes[top = len] = u;
+        }
       }
-      return;
+      for (; top && next[top] == NIL; top--)
+        visited.reset(nodes[top]);
+      if (!top)
+        return;
+      const word_t au1 = next[top];
+      next[top] = links[au1].next;
+      path[top] = au1;
+      u = links[au1].to;
+      len = top + 1;
     }
-    if (len == PROOFSIZE)
-      return;
-    word_t au1 = adjlist[u];
-    if (au1 != NIL) {
-      visited.set(u);
-      for (; au1 != NIL; au1 = links[au1].next) {
-        sols[nsols][len] = au1;
-        cycles_with_link(len+1, links[au1].to, dest);
-      }
-      visited.reset(u);
+  }
+
+  // report a cycle of len edges in path
+  void foundcycle(const u32 len) {
+    print_log("  %d-cycle found\n", len);
+    if (len == PROOFSIZE && nsols < MAXSOLS) {
+      memcpy(sols[nsols], path, sizeof(proof));
+      qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
     }
   }
 
@@ -123,9 +146,9 @@ public:
       u = tmp;
     }
     if (adjlist[v] != NIL) { // possibly part of a cycle
-      sols[nsols][0] = nlinks;
+      path[0] = nlinks;
       assert(!visited.test(u));
-      cycles_with_link(1, v, u);
+      cycles_with_link(v, u);
     }
     word_t ulink = nlinks++;
     assert(ulink != NIL);    // avoid confusing links with NIL; guaranteed if bits in word_t > EDGEBITS + 1
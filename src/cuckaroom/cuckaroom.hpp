@@ -9,6 +9,7 @@
 #include <ctime>
 #include "../crypto/blake2.h"
 #include "../crypto/siphash.hpp"
+#include "../crypto/sipblockxN.h"
 
 // save some keystrokes since i'm a lazy typer
 typedef uint32_t u32;
@@ -130,10 +131,16 @@ u64 sipblock(siphash_keys &keys, const word_t edge, u64 *buf) {
   return buf[edge & EDGE_BLOCK_MASK];
 }
 
+// fills buffer with siphash outputs for the NSIPHASH blocks starting at edge0s,
+// output i of block l in buf[i*NSIPHASH + l]
+void sipblockN(const siphash_keys &keys, const u64 *edge0s, u64 *buf) {
+  sipblockxN<21, SIPBLOCK_XOR_SUFFIX>(keys, edge0s, buf);
+}
+
 // verify that edges are ascending and form a cycle in header-generated graph
 int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
   word_t xorfrom = 0, xorto = 0;
-  u64 sips[EDGE_BLOCK_SIZE];
+  u64 sips[PROOFSIZE];
   word_t from[PROOFSIZE], to[PROOFSIZE],visited[PROOFSIZE];
 
   for (u32 n = 0; n < PROOFSIZE; n++) {
@@ -141,7 +148,10 @@ int verify(word_t edges[PROOFSIZE], siphash_keys &keys) {
       return POW_TOO_BIG;
     if (n && edges[n] <= edges[n-1])
       return POW_TOO_SMALL;
-    u64 edge = sipblock(keys, edges[n], sips);
+  }
+  sipedgesxN<21, SIPBLOCK_XOR_SUFFIX>(keys, edges, PROOFSIZE, sips);
+  for (u32 n = 0; n < PROOFSIZE; n++) {
+    const u64 edge = sips[n];
     xorfrom ^= from[n] =  edge        & EDGEMASK;
     xorto   ^= to  [n] = (edge >> 32) & EDGEMASK;
     visited[n] = false;
@@ -32,24 +32,32 @@ public:
   }
 
   void find_cycles() {
-    u64 sips[EDGE_BLOCK_SIZE];
-    for (word_t block = 0; block < NEDGES; block += EDGE_BLOCK_SIZE) {
-      sipblock(sip_keys, block, sips);
-      for (u32 i = 0; i < EDGE_BLOCK_SIZE; i++) {
-        u64 edge = sips[i];
-        word_t u = edge & NODEMASK;
-        word_t v = (edge >> 32) & NODEMASK;
-        cg.add_edge(u, v);
+    const u32 NEBS = NSIPHASH * EDGE_BLOCK_SIZE;
+    alignas(64) u64 edge0s[NSIPHASH];
+    alignas(64) u64 sips[NEBS];
+    for (word_t block0 = 0; block0 < NEDGES; block0 += NEBS) {
+      for (u32 ns = 0; ns < NSIPHASH; ns++)
+        edge0s[ns] = block0 + ns * EDGE_BLOCK_SIZE;
+      sipblockN(sip_keys, edge0s, sips);
+      for (u32 ns = 0; ns < NSIPHASH; ns++) {
+        const word_t block = edge0s[ns];
+        if (block >= NEDGES) break;
+        for (u32 i = 0; i < EDGE_BLOCK_SIZE; i++) {
+          u64 edge = sips[i * NSIPHASH + ns];
+          word_t u = edge & NODEMASK;
+          word_t v = (edge >> 32) & NODEMASK;
+          cg.add_edge(u, v);
 #ifdef SHOW
-        word_t nonce = block + i;
-        printf("%d add (%d,%d)\n", nonce,u,v+NNODES);
-        for (unsigned j=0; j<NNODES; j++) {
-          printf("\t%d",j);
-          for (int a=cg.adjlist[j]; a!=graph<word_t>::NIL; a=cg.links[a].next) printf(":%d", cg.links[a^1].to);
-          if ((j+1) % NNODES == 0)
-          printf("\n");
-        }
+          word_t nonce = block + i;
+          printf("%d add (%d,%d)\n", nonce,u,v+NNODES);
+          for (unsigned j=0; j<NNODES; j++) {
+            printf("\t%d",j);
+            for (int a=cg.adjlist[j]; a!=graph<word_t>::NIL; a=cg.links[a].next) printf(":%d", cg.links[a^1].to);
+            if ((j+1) % NNODES == 0)
+            printf("\n");
+          }
 #endif
+        }
       }
     }
     for (u32 s=0; s < cg.nsols; s++) {
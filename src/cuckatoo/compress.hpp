@@ -1,7 +1,18 @@
 #include <new>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// slots in a bucket, probed together
+#define COMPRESS_BUCKET 8
 
 // compressor for cuckatoo nodes where edgetrimming
-// has left at most 2^-compressbits nodes in each partition
+// has left at most 2^-compressbits nodes in each partition.
+// node pairs go in an open addressing table of buckets, each filled
+// from the front, that are probed a bucket at a time. that needs tags
+// that hold the node bits lost in rounding homes down to a bucket, and
+// where they don't, as with 32 bit words at EDGEBITS 32, the table is
+// probed a slot at a time from a home slot instead
 template <typename word_t>
 class compressor {
 public:
@@ -12,6 +23,7 @@ public:
   word_t SIZE;
   word_t MASK;
   word_t MASK1;
+  bool bucketed;
   word_t npairs;
   const word_t NIL = ~(word_t)0;
   word_t *nodes;
@@ -23,9 +35,11 @@ public:
     SIZEBITS = NODEBITS-COMPRESSBITS;
     SIZEBITS1 = SIZEBITS-1;
     SIZE = (word_t)1 << SIZEBITS;
-    assert(SIZE);
+    assert(SIZE >= COMPRESS_BUCKET);
     MASK = SIZE-1;
     MASK1 = MASK >> 1;
+    // tags hold node bits 1 up to sizeof(word_t)*8 - SIZEBITS1
+    bucketed = sizeof(word_t)*8 - SIZEBITS1 >= COMPRESSBITS + 2;
     nodes = new (bytes) word_t[SIZE];
     sharedmem = true;
   }
@@ -36,9 +50,11 @@ public:
     SIZEBITS = NODEBITS-COMPRESSBITS;
     SIZEBITS1 = SIZEBITS-1;
     SIZE = (word_t)1 << SIZEBITS;
-    assert(SIZE);
+    assert(SIZE >= COMPRESS_BUCKET);
     MASK = SIZE-1;
     MASK1 = MASK >> 1;
+    // tags hold node bits 1 up to sizeof(word_t)*8 - SIZEBITS1
+    bucketed = sizeof(word_t)*8 - SIZEBITS1 >= COMPRESSBITS + 2;
     nodes = new word_t[SIZE];
     sharedmem = false;
   }
@@ -57,23 +73,72 @@ public:
     npairs = 0;
   }
 
+  // first slot of the bucket, or the slot, where probing for node u starts
+  word_t home(const word_t u) const {
+    return bucketed ? (u >> COMPRESSBITS) & ~(word_t)(COMPRESS_BUCKET-1) : u >> COMPRESSBITS;
+  }
+
+  // bitmasks of the slots of the bucket at b that hold node pair tag, and that are free
+  void probe(const word_t b, const word_t tag, u32 &match, u32 &empty) const {
+#ifdef __AVX2__
+    if (sizeof(word_t) == 4) { // all slots with one compare each
+      const __m256i slots = _mm256_loadu_si256((const __m256i *)(nodes + b));
+      const __m256i tags = _mm256_and_si256(slots, _mm256_set1_epi32((int)~MASK1));
+      match = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(tags, _mm256_set1_epi32((int)tag))));
+      empty = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(slots, _mm256_set1_epi32(-1))));
+      match &= ~empty;
+      return;
+    }
+#endif
+    match = empty = 0;
+    for (u32 i = 0; i < COMPRESS_BUCKET; i++) {
+      const word_t cu = nodes[b + i];
+      if (cu == NIL)
+        empty |= 1 << i;
+      else if ((cu & ~MASK1) == tag)
+        match |= 1 << i;
+    }
+  }
+
   word_t compress(word_t u) {
     u32 parity = u & 1;
-    word_t ui = u >> COMPRESSBITS;
+    word_t b = home(u);
     u >>= 1;
-    for (; ; ui = (ui+1) & MASK) {
-      word_t cu = nodes[ui];
+    const word_t tag = u << SIZEBITS1;
+    for (; !bucketed; b = (b+1) & MASK) {
+      const word_t cu = nodes[b];
       if (cu == NIL) {
         if (npairs >= SIZE/2) {
           print_log("NODE OVERFLOW at %x\n", u << 1 | parity);
           return parity;
         }
-        nodes[ui] = u << SIZEBITS1 | npairs;
+        nodes[b] = tag | npairs;
         return (npairs++ << 1) | parity;
       }
-      if ((cu & ~MASK1) == u << SIZEBITS1) {
+      if ((cu & ~MASK1) == tag)
         return ((cu & MASK1) << 1) | parity;
+    }
+    for (; ; b = (b + COMPRESS_BUCKET) & MASK) {
+      u32 match, empty;
+      probe(b, tag, match, empty);
+      if (match) // before any free slot, as buckets fill from the front
+        return ((nodes[b + __builtin_ctz(match)] & MASK1) << 1) | parity;
+      if (empty) {
+        if (npairs >= SIZE/2) {
+          print_log("NODE OVERFLOW at %x\n", u << 1 | parity);
+          return parity;
+        }
+        nodes[b + __builtin_ctz(empty)] = tag | npairs;
+        return (npairs++ << 1) | parity;
       }
     }
   }
+
+  // compress n nodes in place, in order, after prefetching all their home buckets
+  void compress_many(word_t *us, const u32 n) {
+    for (u32 i = 0; i < n; i++)
+      __builtin_prefetch(nodes + home(us[i]));
+    for (u32 i = 0; i < n; i++)
+      us[i] = compress(us[i]);
+  }
 };
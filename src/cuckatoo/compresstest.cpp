@@ -0,0 +1,52 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// test that the node compressor keeps distinct nodes distinct, both where
+// it probes whole buckets, and at EDGEBITS 32 where its tags are too narrow
+// for that. build with -DEDGEBITS=32
+
+#include "cuckatoo.h"
+#include <assert.h>
+#include <set>
+#include <vector>
+#include "compress.hpp"
+
+#if EDGEBITS != 32
+#error build with -DEDGEBITS=32
+#endif
+
+// compress n pseudo random nodes of nodebits bits, and check that
+// no two different ones compress alike. tags can't hold all node bits,
+// so at much higher loads nodes far from home could still get confused
+void distinct(const u32 nodebits, const u32 compressbits, const u32 n) {
+  compressor<word_t> c(nodebits, compressbits);
+  c.reset();
+  std::set<word_t> nodes;
+  std::vector<word_t> compressed(c.SIZE, c.NIL);
+  u64 x = 0x9e3779b97f4a7c15ULL;
+  for (u32 i = 0; i < n; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    const word_t u = (x >> 32) & (((u64)1 << nodebits) - 1);
+    if (!nodes.insert(u).second)
+      continue;
+    const word_t cu = c.compress(u);
+    assert(compressed[cu] == c.NIL || compressed[cu] == u);
+    compressed[cu] = u;
+  }
+  printf("%d bit nodes compressed by %d bits with %s homes: %d nodes in %d pairs kept distinct\n",
+         nodebits, compressbits, c.bucketed ? "bucket" : "slot", (int)nodes.size(), (int)c.npairs);
+}
+
+int main() {
+  compressor<word_t> c(32, 8);
+  c.reset();
+  const word_t u = 0x12345602, v = 0x12345202; // same home bucket, tags alike
+  const word_t cu = c.compress(u), cv = c.compress(v);
+  printf("%x compresses to %x and %x to %x\n", u, cu, v, cv);
+  assert(cu != cv);
+  assert(c.compress(u) == cu && c.compress(v) == cv);
+  distinct(32, 8, 1 << 21);
+  distinct(29, 8, 1 << 19);
+  printf("compress tests passed\n");
+  return 0;
+}
@@ -0,0 +1,77 @@
+// benchmark of the cycle search on the graphs that mean trimming leaves.
+// trims each nonce once, then repeatedly adds its surviving edges to a reset
+// graph on one thread, as findcycles does, and reports the rdtsc cycles taken
+// per run and per edge, along with the number of 42-cycles found.
+// build with -DSQUASH_OUTPUT=1 to keep the search from reporting each cycle
+
+#include "mean.hpp"
+#include <unistd.h>
+#include <inttypes.h> // for PRIu64 macro
+#include <algorithm>
+#include <vector>
+
+// arbitrary length of header hashed into siphash key
+#define HEADERLEN 80
+
+int main(int argc, char **argv) {
+  u32 nthreads = 1;
+  u32 ntrims = EDGEBITS >= 30 ? 96 : 68;
+  u32 nonce = 0;
+  u32 range = 1;
+  u32 nruns = 20;
+  char header[HEADERLEN];
+  int c;
+
+  memset(header, 0, sizeof(header));
+  while ((c = getopt (argc, argv, "k:m:n:r:t:")) != -1) {
+    switch (c) {
+      case 'k':
+        nruns = atoi(optarg);
+        break;
+      case 'm':
+        ntrims = atoi(optarg) & -2; // make even as required by trim()
+        break;
+      case 'n':
+        nonce = atoi(optarg);
+        break;
+      case 'r':
+        range = atoi(optarg);
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+    }
+  }
+  assert(nruns > 0);
+  printf("timing %d cycle searches on cuckatoo%d nonces %d-%d after %d trimming rounds on %d threads\n",
+         nruns, EDGEBITS, nonce, nonce+range-1, ntrims, nthreads);
+
+  solver_ctx *ctx = new solver_ctx(nthreads, ntrims, 0, 0, false, false, true, false, HUGE_NONE, false);
+  graph<word_t> cg(MAXEDGES, MAXEDGES, MAX_SOLS, 0);
+  u64 sumedges = 0, summedian = 0;
+  for (u32 r = 0; r < range; r++) {
+    ctx->setheadernonce(header, sizeof(header), nonce + r);
+    ctx->trimmer.trim(ctx->pool);
+    ctx->savetail(); // surviving edges as findcycles adds them
+    const std::vector<u32> &edges = ctx->tailedges;
+    const u32 nedges = edges.size() / 2;
+    std::vector<u64> runs;
+    for (u32 k = 0; k < nruns; k++) {
+      const u64 rdtsc0 = __rdtsc();
+      cg.reset();
+      for (u32 i = 0; i < 2 * nedges; i += 2)
+        cg.add_edge(edges[i], edges[i+1]);
+      runs.push_back(__rdtsc() - rdtsc0);
+    }
+    std::sort(runs.begin(), runs.end());
+    const u64 median = runs[nruns/2];
+    printf("nonce %d: %d edges %d solutions findcycles rdtsc min %" PRIu64 " median %" PRIu64 ", %.1f per edge\n",
+           nonce + r, nedges, cg.nsols, runs[0], median, (double)median / std::max(nedges, 1u));
+    sumedges += nedges;
+    summedian += median;
+  }
+  printf("total: %" PRIu64 " edges findcycles rdtsc median %" PRIu64 ", %.1f per edge\n",
+         sumedges, summedian, (double)summedian / std::max(sumedges, (u64)1));
+  delete ctx;
+  return 0;
+}
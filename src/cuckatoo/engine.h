@@ -0,0 +1,21 @@
+#pragma once
+// Cuck(at)oo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+#include "solverapi.h"
+
+// the solver api of one compile-time configuration, as linked into a
+// library together with others. the solver contexts are opaque here
+struct solver_engine {
+  const char *name;
+  u32 edgebits;
+  u32 xbits;
+  u32 nsiphash;
+  const char *cpufeature; // needed to run, as known to __builtin_cpu_supports, or 0
+  void *(*create_solver_ctx)(SolverParams *params);
+  int (*run_solver)(void *ctx, char *header, int header_length, u32 nonce, u32 range, SolverSolutions *solutions, SolverStats *stats);
+  void (*destroy_solver_ctx)(void *ctx);
+  void (*stop_solver)(void *ctx);
+  u64 (*sharedbytes)(void *ctx);
+  u64 (*threadbytes)(void *ctx);
+};
@@ -3,7 +3,11 @@
 #include <assert.h>
 #include "bitmap.hpp"
 #include "compress.hpp"
+#include "../threads/pool.hpp"
 #include <new>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 
 typedef word_t proof[PROOFSIZE];
 
@@ -31,6 +35,7 @@ public:
   u32 MAXSOLS;
   proof *sols;
   u32 nsols;
+  proof path; // of the cycle search of add_edge
 
   graph(word_t maxedges, word_t maxnodes, u32 maxsols, u32 compressbits) : visited(maxedges) {
     MAXEDGES = maxedges;
@@ -41,11 +46,13 @@ public:
     compressu = compressbits ? new compressor<word_t>(EDGEBITS, compressbits) : 0;
     compressv = compressbits ? new compressor<word_t>(EDGEBITS, compressbits) : 0;
     sharedmem = false;
-    sols    = new proof[MAXSOLS+1]; // extra one for current path
+    sols    = new proof[MAXSOLS];
     visited.clear();
   }
 
   ~graph() {
+    for (searcher *s : searchers)
+      delete s;
     if (!sharedmem) {
       delete[] adjlist;
       delete[] links;
@@ -62,7 +69,7 @@ public:
     compressu = compressbits ? new compressor<word_t>(EDGEBITS, compressbits, bytes += sizeof(link[2*MAXEDGES])) : 0;
     compressv = compressbits ? new compressor<word_t>(EDGEBITS, compressbits, bytes + compressu->bytes()) : 0;
     sharedmem = true;
-    sols    = new  proof[MAXSOLS+1];
+    sols    = new  proof[MAXSOLS];
     visited.clear();
   }
 
@@ -87,33 +94,58 @@ public:
   }
 
   static int nonce_cmp(const void *a, const void *b) {
-    u32 x = *(u32 *)a, y = *(u32 *)b;
+    word_t x = *(word_t *)a, y = *(word_t *)b;
     // printf("nonce_cmp %x %x\n", x, y);
     return x < y ? -1 : x > y;
   }
 
-  void cycles_with_link(u32 len, word_t u, word_t dest) {
-    // assert((u>>1) < MAXEDGES);
-    if (visited.test(u >> 1))
-      return;
-    if ((u ^ 1) == dest) {
-      print_log("  %d-cycle found\n", len);
-      if (len == PROOFSIZE && nsols < MAXSOLS) {
-        memcpy(sols[nsols+1], sols[nsols], sizeof(sols[0]));
-        qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
+  // depth first search for all paths of at most PROOFSIZE edges that extend
+  // edge path[0] from node u to the pair of node dest, calling found(len) for
+  // each with the cycle in path[0..len-1], in the order of a recursive search.
+  // the search keeps its own stack of adjacency list positions, and follows
+  // the last edge of a path only to check whether it reaches dest, whose
+  // node pair may already be on the path if the search went through dest.
+  // vis marks the node pairs on the current path, and is clear again at the end
+  template <typename F>
+  void cycles_with_link(bitmap<u32> &vis, word_t *path, word_t u, const word_t dest, F found) {
+    word_t nodes[PROOFSIZE]; // on the path, by length of the path up to them
+    word_t next[PROOFSIZE];  // next link to follow from there
+    u32 top = 0;             // deepest node with links to follow
+    for (u32 len = 1; ; ) {  // at node u with a path of len edges
+      if (!vis.test(u >> 1)) {
+        if ((u ^ 1) == dest)
+          found(len);
+        else if (len == PROOFSIZE - 1) {
+          for (word_t au1 = adjlist[u ^ 1]; au1 != NIL; au1 = links[au1].next) {
+            const word_t v = links[au1 ^ 1].to;
+            if ((v ^ 1) == dest && !vis.test(v >> 1)) {
+              path[len] = au1/2;
+              found(PROOFSIZE);
+            }
+          }
+        } else if ((next[len] = adjlist[u ^ 1]) != NIL) {
+          vis.set(u >> 1);
+          nodes[top = len] = u;
+        }
       }
-      return;
+      for (; top && next[top] == NIL; top--)
+        vis.reset(nodes[top] >> 1);
+      if (!top)
+        return;
+      const word_t au1 = next[top];
+      next[top] = links[au1].next;
+      path[top] = au1/2;
+      u = links[au1 ^ 1].to;
+      len = top + 1;
     }
-    if (len == PROOFSIZE)
-      return;
-    word_t au1 = adjlist[u ^ 1];
-    if (au1 != NIL) {
-      visited.set(u >> 1);
-      for (; au1 != NIL; au1 = links[au1].next) {
-        sols[nsols][len] = au1/2;
-        cycles_with_link(len+1, links[au1 ^ 1].to, dest);
-      }
-      visited.reset(u >> 1);
+  }
+
+  // report a cycle of len edges in path
+  void foundcycle(const u32 len) {
+    print_log("  %d-cycle found\n", len);
+    if (len == PROOFSIZE && nsols < MAXSOLS) {
+      memcpy(sols[nsols], path, sizeof(proof));
+      qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
     }
   }
 
@@ -122,9 +154,9 @@ public:
     assert(v < MAXNODES);
     v += MAXNODES; // distinguish partitions
     if (adjlist[u ^ 1] != NIL && adjlist[v ^ 1] != NIL) { // possibly part of a cycle
-      sols[nsols][0] = nlinks/2;
+      path[0] = nlinks/2;
       assert(!visited.test(u >> 1));
-      cycles_with_link(1, u, v);
+      cycles_with_link(visited, path, u, v, [this](const u32 len) { foundcycle(len); });
     }
     word_t ulink = nlinks++;
     word_t vlink = nlinks++; // the two halfedges of an edge differ only in last bit
@@ -143,4 +175,147 @@ public:
   bool add_compress_edge(word_t u, word_t v) {
     return add_edge(compressu->compress(u), compressv->compress(v));
   }
+
+  // add_compress_edge of n edges us[i],vs[i], compressing them in place
+  void add_compress_edges(word_t *us, word_t *vs, const u32 n) {
+    compressu->compress_many(us, n);
+    compressv->compress_many(vs, n);
+    for (u32 i = 0; i < n; i++)
+      add_edge(us[i], vs[i]);
+  }
+
+  // multithreaded add_edge of nedges edges uvs[2*i],uvs[2*i+1], finding the
+  // same cycles in the same order. cycles stay within a connected component
+  // of the graph on node pairs u>>1, and adding the edges of one component in
+  // order finds the same cycles as adding all edges in order, so components
+  // get searched on separate threads. every edge uses the same links as it
+  // would in add_edge, so adjacency lists and cycle edges are unchanged.
+  struct cycle {
+    word_t edge; // whose addition closed the cycle
+    u32 len;
+    proof edges; // if len == PROOFSIZE
+  };
+  struct searcher { // per thread state of the cycle search
+    bitmap<u32> visited;
+    proof path;
+    std::vector<cycle> found;
+    searcher(word_t maxedges) : visited(maxedges) {
+      visited.clear();
+    }
+  };
+  std::vector<word_t> compof;   // union-find parent of node pair, then component of edge
+  std::vector<word_t> compedges; // edges ordered by component
+  std::vector<word_t> compstart; // where each component starts in compedges
+  std::vector<word_t> comporder; // components by decreasing size
+  std::vector<searcher *> searchers;
+  const word_t *adduvs;
+  std::atomic<word_t> nextcomp;
+
+  word_t findroot(word_t x) {
+    while (compof[x] != x)
+      x = compof[x] = compof[compof[x]]; // path halving
+    return x;
+  }
+
+  // add_edge as edge number i, with the search state of the calling thread
+  void add_edge(searcher &s, const word_t i, word_t u, word_t v) {
+    v += MAXNODES; // distinguish partitions
+    if (adjlist[u ^ 1] != NIL && adjlist[v ^ 1] != NIL) { // possibly part of a cycle
+      s.path[0] = i;
+      cycles_with_link(s.visited, s.path, u, v, [&s, i](const u32 len) {
+        s.found.push_back(cycle());
+        cycle &c = s.found.back();
+        c.edge = i;
+        c.len = len;
+        if (len == PROOFSIZE) // sorted if it makes it into sols
+          memcpy(c.edges, s.path, sizeof(proof));
+      });
+    }
+    const word_t ulink = 2*i, vlink = 2*i+1;
+#ifndef ALLOWDUPES
+    for (word_t au = adjlist[u]; au != NIL; au = links[au].next)
+      if (links[au ^ 1].to == v) return; // drop duplicate edge
+#endif
+    links[ulink].next = adjlist[u];
+    links[vlink].next = adjlist[v];
+    links[adjlist[u] = ulink].to = u;
+    links[adjlist[v] = vlink].to = v;
+  }
+
+  void add_components(const u32 id) {
+    searcher &s = *searchers[id];
+    s.found.clear();
+    for (word_t c; (c = nextcomp++) < comporder.size(); ) {
+      const word_t comp = comporder[c];
+      for (word_t j = compstart[comp]; j < compstart[comp+1]; j++) {
+        const word_t i = compedges[j];
+        add_edge(s, i, adduvs[2*i], adduvs[2*i+1]);
+      }
+    }
+  }
+
+  static void addworker(void *vp, const unsigned id) {
+    ((graph *)vp)->add_components(id);
+  }
+
+  static bool cycle_cmp(const cycle &a, const cycle &b) {
+    return a.edge < b.edge;
+  }
+
+  // as many calls to add_edge, on a reset graph
+  void add_edges(const word_t *uvs, const word_t nedges, thread_pool &pool) {
+    assert(nlinks == 0 && 2*nedges <= 2*MAXEDGES);
+    compof.resize(MAXNODES);
+    for (word_t x = 0; x < MAXNODES; x++)
+      compof[x] = x;
+    for (word_t i = 0; i < nedges; i++) {
+      assert(uvs[2*i] < MAXNODES && uvs[2*i+1] < MAXNODES);
+      const word_t ru = findroot(uvs[2*i] >> 1), rv = findroot((uvs[2*i+1] + MAXNODES) >> 1);
+      if (ru != rv)
+        compof[std::max(ru, rv)] = std::min(ru, rv);
+    }
+    // number the components. parents are smaller than their children,
+    // so compof[x] can be replaced by its parent's number in one sweep
+    std::vector<word_t> edgecomp(nedges);
+    compstart.assign(1, 0);
+    for (word_t x = 0; x < MAXNODES; x++) {
+      if (compof[x] == x) {
+        compof[x] = compstart.size() - 1;
+        compstart.push_back(0);
+      } else compof[x] = compof[compof[x]];
+    }
+    for (word_t i = 0; i < nedges; i++)
+      compstart[(edgecomp[i] = compof[uvs[2*i] >> 1]) + 1]++;
+    const word_t ncomps = compstart.size() - 1;
+    comporder.clear();
+    for (word_t c = 0; c < ncomps; c++)
+      if (compstart[c+1] > 0)
+        comporder.push_back(c);
+    // biggest first for better load balance
+    std::stable_sort(comporder.begin(), comporder.end(), [this](word_t a, word_t b) { return compstart[a+1] > compstart[b+1]; });
+    for (word_t c = 0; c < ncomps; c++)
+      compstart[c+1] += compstart[c];
+    compedges.resize(nedges);
+    std::vector<word_t> fill(compstart.begin(), compstart.end() - 1);
+    for (word_t i = 0; i < nedges; i++)
+      compedges[fill[edgecomp[i]]++] = i;
+    while (searchers.size() < pool.nthreads)
+      searchers.push_back(new searcher(MAXEDGES));
+    adduvs = uvs;
+    nextcomp = 0;
+    pool.run(addworker, (void *)this);
+    nlinks = 2 * nedges;
+    // report the cycles in the order add_edge would have found them
+    std::vector<cycle> found;
+    for (u32 t = 0; t < pool.nthreads; t++)
+      found.insert(found.end(), searchers[t]->found.begin(), searchers[t]->found.end());
+    std::stable_sort(found.begin(), found.end(), cycle_cmp);
+    for (const cycle &c : found) {
+      print_log("  %d-cycle found\n", c.len);
+      if (c.len == PROOFSIZE && nsols < MAXSOLS) {
+        memcpy(sols[nsols], c.edges, sizeof(proof));
+        qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
+      }
+    }
+  }
 };
@@ -0,0 +1,42 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// regression test of the cycle search on small hand made graphs, both by
+// add_edge and by the multithreaded add_edges. build with -DPROOFSIZE=4
+
+#include "cuckatoo.h"
+#include "graph.hpp"
+
+#if PROOFSIZE != 4
+#error build with -DPROOFSIZE=4
+#endif
+
+// number of PROOFSIZE-cycles found in the graph of nedges edges uvs[2*i],uvs[2*i+1]
+u32 nsols(const word_t *uvs, const u32 nedges, const u32 nthreads) {
+  graph<word_t> g(64, 64, 4, 0); // visited bitmap needs whole words
+  thread_pool pool(nthreads);
+  g.reset();
+  if (nthreads == 1) {
+    for (u32 i = 0; i < nedges; i++)
+      g.add_edge(uvs[2*i], uvs[2*i+1]);
+  } else g.add_edges(uvs, nedges, pool);
+  return g.nsols;
+}
+
+int main() {
+  // the last edge closes a path through the pair of its v node twice over,
+  // reaching v itself on the way. that is no cycle
+  const word_t twice[] = { 1,2, 4,3, 5,3, 0,2 };
+  // u pairs {0,1} {2,3} and v pairs {0,1} {2,3} all connected
+  const word_t square[] = { 0,0, 2,1, 3,2, 1,3 };
+  for (u32 nthreads = 1; nthreads <= 2; nthreads++) {
+    u32 n = nsols(twice, 4, nthreads);
+    printf("%d threads: %d cycles through a node pair twice\n", nthreads, n);
+    assert(n == 0);
+    n = nsols(square, 4, nthreads);
+    printf("%d threads: %d cycles on a square\n", nthreads, n);
+    assert(n == 1);
+  }
+  printf("graph tests passed\n");
+  return 0;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// allocation of large solver buffers with fewer TLB misses.
+// HUGE_1GB and HUGE_2MB need pages reserved in /proc/sys/vm/nr_hugepages
+// (or /sys/kernel/mm/hugepages/), while HUGE_THP asks for transparent huge pages
+// which the kernel may or may not provide. every mode falls back to the next
+// smaller one when unavailable, down to regular pages.
+enum hugepage_mode { HUGE_NONE, HUGE_THP, HUGE_2MB, HUGE_1GB };
+const char *hugepage_names[] = { "4KB pages", "transparent huge pages", "2MB huge pages", "1GB huge pages" };
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+const uint64_t HUGE_PAGE_2MB = 1ULL << 21;
+const uint64_t HUGE_PAGE_1GB = 1ULL << 30;
+
+uint64_t hugepage_round(const uint64_t bytes, const hugepage_mode mode) {
+  const uint64_t pagesize = mode == HUGE_1GB ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+  return (bytes + pagesize - 1) & ~(pagesize - 1);
+}
+
+// allocate bytes using the largest page size not exceeding mode that works;
+// mode is updated to the one actually used. returns 0 if out of memory
+void *hugepage_alloc(const uint64_t bytes, hugepage_mode &mode) {
+  void *p;
+#ifdef MAP_HUGETLB
+  for (; mode >= HUGE_2MB; mode = (hugepage_mode)(mode - 1)) {
+    const int pageflag = mode == HUGE_1GB ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+    p = mmap(0, hugepage_round(bytes, mode), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|pageflag, -1, 0);
+    if (p != MAP_FAILED)
+      return p;
+  }
+#else
+  if (mode > HUGE_THP)
+    mode = HUGE_THP;
+#endif
+  p = mmap(0, hugepage_round(bytes, mode), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return 0;
+#ifdef MADV_HUGEPAGE
+  if (mode == HUGE_THP && madvise(p, hugepage_round(bytes, mode), MADV_HUGEPAGE))
+    mode = HUGE_NONE;
+#else
+  mode = HUGE_NONE;
+#endif
+  return p;
+}
+
+void hugepage_free(void *p, const uint64_t bytes, const hugepage_mode mode) {
+  if (p)
+    munmap(p, hugepage_round(bytes, mode));
+}
+
+// allocate bytes backed by an unlinked temporary file in directory dir, on a
+// local drive or tmpfs, for buffers larger than memory. the kernel pages them
+// in and out through the page cache. returns 0 on failure, else sets fd
+void *filemap_alloc(const char *dir, const uint64_t bytes, int &fd) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/cuckoo-buckets-XXXXXX", dir);
+  fd = mkstemp(path);
+  if (fd < 0)
+    return 0;
+  unlink(path);
+  void *p = ftruncate(fd, bytes) ? MAP_FAILED : mmap(0, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  return p;
+}
+
+void filemap_free(void *p, const uint64_t bytes, const int fd) {
+  munmap(p, bytes);
+  close(fd);
+}
+
+// discard the file contents, so that rewriting them doesn't read them back in,
+// and tmpfs releases their memory. punching a hole keeps the mapping intact;
+// where that is unsupported, the file is truncated and extended again.
+// returns false, with errno set, if neither works
+bool filemap_clear(const int fd, const uint64_t bytes) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+  if (!fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, 0, bytes))
+    return true;
+#endif
+  return !ftruncate(fd, 0) && !ftruncate(fd, bytes);
+}
+
+// start reading in the given part of a file mapping, without waiting for it
+void filemap_willneed(const void *p, const uint64_t bytes) {
+  const uintptr_t page = 4096, from = (uintptr_t)p & ~(page - 1);
+  madvise((void *)from, (uintptr_t)p + bytes - from, MADV_WILLNEED);
+}
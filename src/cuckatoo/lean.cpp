@@ -167,6 +167,15 @@ int main(int argc, char **argv) {
   for (NodeUnit=0; NodeBytes >= 1024; NodeBytes>>=10,NodeUnit++) ;
   print_log("Using %d%cB edge and %d%cB node memory, and %d-way siphash\n",
      (int)EdgeBytes, " KMGT"[EdgeUnit], (int)NodeBytes, " KMGT"[NodeUnit], NSIPHASH);
+#ifdef MEMORY_MB
+  print_log("Partitioning nodes %d ways to fit in %dMB\n", 1 << PART_BITS, MEMORY_MB);
+#endif
+#if STAGE_SHIFT
+  u64 StageBytes = std::max((u64)64 * nthreads * NREGIONS, (u64)NEDGES >> STAGE_SHIFT) * sizeof(u32);
+  int StageUnit;
+  for (StageUnit=0; StageBytes >= 1024; StageBytes>>=10,StageUnit++) ;
+  print_log("Staging node degrees with %d%cB in %d regions\n", (int)StageBytes, " KMGT"[StageUnit], NREGIONS);
+#endif
 
   SolverCtx* ctx = create_solver_ctx(&params);
   run_solver(ctx, header, len, nonce, range, NULL, NULL);
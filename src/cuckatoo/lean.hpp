@@ -13,7 +13,12 @@
 #include <stdio.h>
 #include <pthread.h>
 #include "../threads/barrier.hpp"
+#include "../threads/spsc.hpp"
+#include <sched.h>
+#include <x86intrin.h>
+#include <vector>
 #include <assert.h>
+#include <algorithm>
 
 #ifndef MAXSOLS
 #define MAXSOLS 4
@@ -29,18 +34,36 @@ typedef u32 au32;
 typedef u64 au64;
 #endif
 
-// algorithm/performance parameters; assume EDGEBITS < 31
+// algorithm/performance parameters; edge indices above 2^32 use 64-bit word_t
 
 const u32 NODEBITS = EDGEBITS + 1;
 
+// bytes taken by the edge and node bitmaps when partitioning with pb bits
+#define LEAN_BYTES(pb) ((1ULL << (EDGEBITS-3)) + (1ULL << (EDGEBITS-3-(pb))))
+
 #ifndef PART_BITS
 // #bits used to partition edge set processing to save memory
 // a value of 0 does no partitioning and is fastest
 // a value of 1 partitions in two, making twice_set the
 // same size as shrinkingset at about 33% slowdown
 // higher values are not that interesting
+#ifdef MEMORY_MB
+// the least partitioning that fits the bitmaps in MEMORY_MB megabytes
+#if LEAN_BYTES(0) <= (MEMORY_MB << 20)
+#define PART_BITS 0
+#elif LEAN_BYTES(1) <= (MEMORY_MB << 20)
+#define PART_BITS 1
+#elif LEAN_BYTES(2) <= (MEMORY_MB << 20)
+#define PART_BITS 2
+#elif LEAN_BYTES(3) <= (MEMORY_MB << 20)
+#define PART_BITS 3
+#else
+#error MEMORY_MB too small for the edge bitmap
+#endif
+#else
 #define PART_BITS 0
 #endif
+#endif
 
 #ifndef NPREFETCH
 // how many prefetches to queue up
@@ -49,11 +72,38 @@ const u32 NODEBITS = EDGEBITS + 1;
 #define NPREFETCH 32
 #endif
 
+#ifndef STAGE_SHIFT
+// if nonzero, count node degrees by first staging the hashed endpoints in
+// per-thread buckets keyed by nonleaf region, and then setting their bits
+// region by region, each thread owning whole regions that stay in cache.
+// each pass stages up to about NEDGES >> STAGE_SHIFT endpoints at 4 bytes each,
+// so smaller values take more memory and fewer passes over the bitmap.
+// a value of 0 sets bits directly with atomic updates and uses no extra memory
+#define STAGE_SHIFT 0
+#endif
+
+#ifndef REGION_BITS
+// 2-log of the number of nonleaf bits in a region, sized to fit in L2 cache
+#define REGION_BITS 21
+#endif
+
+#ifndef SUMMARY_SHIFT
+// if nonzero, once fewer than NEDGES >> SUMMARY_SHIFT edges are alive, each thread
+// keeps a summary bit per 64-edge block of its own, cleared when the block runs out
+// of alive edges, so that trimming rounds skip dead blocks and take time
+// proportional to the number of live blocks. the summary takes NEDGES/64 bits
+#define SUMMARY_SHIFT 5
+#endif
+
 #ifndef IDXSHIFT
 // minimum shift that allows cycle finding data to fit in node bitmap space
 // allowing them to share the same memory
+#if EDGEBITS > 32
+#define IDXSHIFT (PART_BITS + 9) // as 64-bit word_t doubles the cycle finding data
+#else
 #define IDXSHIFT (PART_BITS + 8)
 #endif
+#endif
 #define MAXEDGES (NEDGES >> IDXSHIFT)
 
 const u32 PART_MASK = (1 << PART_BITS) - 1;
@@ -64,23 +114,66 @@ const word_t NONPART_MASK = -1;
 const word_t NONPART_MASK = ((word_t)1 << NONPART_BITS) - 1;
 #endif
 
-// set that starts out full and gets reset by threads on disjoint words
+#ifdef SHARDED
+// each thread owns a contiguous range of nonleaf words, whose bits it alone sets,
+// without atomic updates. endpoints in other ranges go to their owner through
+// a single-producer single-consumer queue per pair of threads
+#if STAGE_SHIFT
+#error SHARDED and STAGE_SHIFT are alternatives
+#endif
+#ifndef QUEUE_BITS
+// 2-log of the number of endpoints in each queue
+#define QUEUE_BITS 10
+#endif
+// endpoints per queue push
+#define SHARD_BATCH 64
+typedef spsc_queue<word_t, QUEUE_BITS> shard_queue;
+#endif
+
+#if REGION_BITS < NONPART_BITS
+#define NREGIONS (1 << (NONPART_BITS - REGION_BITS))
+#else
+#define NREGIONS 1
+#endif
+const word_t REGION_MASK = ((word_t)1 << REGION_BITS) - 1;
+
+// set that starts out full and gets reset by threads on disjoint words.
+// thread id owns blocks 64 * (id + loop * nthreads) for loop < nloops
 class shrinkingset {
 public:
   bitmap<u64> bmap;
   u64 *cnt;
   u32 nthreads;
+  word_t nloops;
+#if SUMMARY_SHIFT
+  u32 livewords;   // per thread, padded to whole cache lines
+  u64 *live;       // per thread, a bit per owned block that may have alive edges
+  bool *summarized; // per thread, whether its live bits are in use
+#endif
 
   shrinkingset(const u32 nt) : bmap(NEDGES) {
     nthreads = nt;
+    nloops = NEDGES / 64 / nt;
     cnt  = new u64[nt];
+#if SUMMARY_SHIFT
+    livewords = (nloops + 511) / 512 * 8;
+    live = new u64[(u64)nt * livewords];
+    summarized = new bool[nt];
+#endif
   }
   ~shrinkingset() {
     delete[] cnt;
+#if SUMMARY_SHIFT
+    delete[] live;
+    delete[] summarized;
+#endif
   }
   void clear() {
     bmap.clear();
     memset(cnt, 0, nthreads * sizeof(u64));
+#if SUMMARY_SHIFT
+    memset(summarized, 0, nthreads * sizeof(bool));
+#endif
   }
   u64 count() const {
     u64 sum = NEDGES;
@@ -98,6 +191,41 @@ public:
   u64 block(word_t n) const {
     return ~bmap.block(n);
   }
+  // first loop of thread id from loop on whose block may have alive edges, or nloops
+  word_t nextlive(const u32 id, word_t loop) const {
+#if SUMMARY_SHIFT
+    if (summarized[id] && loop < nloops) {
+      const u64 *lw = live + (u64)id * livewords;
+      u64 w = lw[loop / 64] >> (loop % 64);
+      while (!w) {
+        loop = (loop | 63) + 1;
+        if (loop >= nloops)
+          return nloops;
+        w = lw[loop / 64];
+      }
+      loop += __builtin_ctzll(w);
+    }
+#endif
+    return loop;
+  }
+  // let thread id drop its dead blocks from the summary, starting it once few edges
+  // are left. count must be stable, i.e. no thread may be resetting
+  void summarize(const u32 id) {
+#if SUMMARY_SHIFT
+    u64 *lw = live + (u64)id * livewords;
+    if (!summarized[id]) {
+      if (count() >= NEDGES >> SUMMARY_SHIFT)
+        return;
+      memset(lw, 0, livewords * sizeof(u64));
+      for (word_t loop = 0; loop < nloops; loop++)
+        lw[loop / 64] |= (u64)1 << (loop % 64);
+      summarized[id] = true;
+    }
+    for (word_t loop = nextlive(id, 0); loop < nloops; loop = nextlive(id, loop + 1))
+      if (!block(64 * (id + loop * nthreads)))
+        lw[loop / 64] &= ~((u64)1 << (loop % 64));
+#endif
+  }
 };
 
 class cuckoo_ctx {
@@ -113,6 +241,15 @@ public:
   u32 ntrims;
   bool mutatenonce;
   trim_barrier barry;
+#if STAGE_SHIFT
+  u32 nslots;   // per thread and region
+  u32 *stage;   // per thread and region, nslots staged region offsets of nonleaf bits
+  u32 *nstaged; // per thread and region, number of staged offsets
+#endif
+#ifdef SHARDED
+  shard_queue *queues;    // from thread i to thread j at i*nthreads+j
+  std::atomic<u32> ndone; // threads done queueing endpoints
+#endif
 
   cuckoo_ctx(u32 n_threads, u32 n_trims, u32 max_sols, bool mutate_nonce) : alive(n_threads), nonleaf(NNODES1 >> PART_BITS),
       cg(MAXEDGES, MAXEDGES, max_sols, IDXSHIFT, (char *)nonleaf.bits), barry(n_threads) {
@@ -123,6 +260,14 @@ public:
     sols = new proof[max_sols];
     nsols = 0;
     mutatenonce = mutate_nonce;
+#if STAGE_SHIFT
+    nslots = std::max((u64)64, ((u64)NEDGES >> STAGE_SHIFT) / nthreads / NREGIONS);
+    stage = new u32[(u64)nthreads * NREGIONS * nslots];
+    nstaged = new u32[nthreads * NREGIONS]();
+#endif
+#ifdef SHARDED
+    queues = new shard_queue[nthreads * nthreads];
+#endif
   }
   void setheadernonce(char* headernonce, const u32 len, const u32 nce) {
     nonce = nce;
@@ -135,6 +280,13 @@ public:
   }
   ~cuckoo_ctx() {
     delete[] sols;
+#if STAGE_SHIFT
+    delete[] stage;
+    delete[] nstaged;
+#endif
+#ifdef SHARDED
+    delete[] queues;
+#endif
   }
   void barrier() {
     barry.wait();
@@ -166,6 +318,159 @@ public:
       }
     }
   }
+#if STAGE_SHIFT
+  // stage endpoints in part into the region buckets of thread id,
+  // or set them directly when their bucket is full
+  void stage_deg(const u64 *hashes, const u32 nsiphash, const u32 part, const u32 id) {
+    u32 *cnt = nstaged + (u64)id * NREGIONS;
+    u32 *buckets = stage + (u64)id * NREGIONS * nslots;
+    for (u32 i=0; i < nsiphash; i++) {
+      u64 u = hashes[i] & NODEMASK;
+      if ((u >> NONPART_BITS) == part) {
+        const word_t w = u & NONPART_MASK;
+        const u32 r = w >> REGION_BITS;
+        if (cnt[r] < nslots)
+          buckets[(u64)r * nslots + cnt[r]++] = w & REGION_MASK;
+        else nonleaf.set(w);
+      }
+    }
+  }
+  // set the nonleaf bits staged by all threads in the regions owned by thread id
+  void apply_deg(const u32 id) {
+    const u32 endr = NREGIONS * (id+1) / nthreads;
+    for (u32 r = NREGIONS * id / nthreads; r < endr; r++) {
+      const word_t w0 = (word_t)r << REGION_BITS;
+      for (u32 t = 0; t < nthreads; t++) {
+        u32 &cnt = nstaged[(u64)t * NREGIONS + r];
+        const u32 *bucket = stage + ((u64)t * NREGIONS + r) * nslots;
+        for (u32 i = 0; i < cnt; i++)
+          nonleaf.set_owned(w0 | bucket[i]);
+        cnt = 0;
+      }
+    }
+  }
+  void count_node_deg(const u32 id, const u32 uorv, const u32 part) {
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    word_t nloops = NEDGES / 64 / nthreads;
+    // blocks per pass expected to fill half the buckets, the same for all threads
+    const double perloop = 64.0 * (alive.count() + 1) / NEDGES / (1 << PART_BITS);
+    const double fitloops = nslots * NREGIONS / 2 / perloop;
+    const word_t passloops = fitloops < 1 ? 1 : fitloops < nloops ? (word_t)fitloops : nloops;
+    if (id == 0 && part == 0)
+      nonleaf.set(0); // as set by the zero hashes of direct counting, keeping kill's dummy hashes harmless
+    u32 nidx = 0;
+    for (word_t loop0 = 0; loop0 < nloops; loop0 += passloops) {
+      const word_t endloop = std::min(loop0 + passloops, nloops);
+      for (word_t loop = alive.nextlive(id, loop0); loop < endloop; loop = alive.nextlive(id, loop+1)) {
+        word_t block = 64 * (id + loop * nthreads);
+        u64 alive64 = alive.block(block);
+        for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
+          u32 ffs = __builtin_ffsll(alive64);
+          nonce += ffs; alive64 >>= ffs;
+          indices[nidx++] = 2*(u64)nonce + uorv;
+          if (nidx == NSIPHASH) {
+            siphash24xN(&sip_keys, indices, hashes);
+            stage_deg(hashes, NSIPHASH, part, id);
+            nidx = 0;
+          }
+          if (ffs & 64) break; // can't shift by 64
+        }
+      }
+      if (nidx) {
+        siphash24xN(&sip_keys, indices, hashes);
+        stage_deg(hashes, nidx, part, id);
+        nidx = 0;
+      }
+      barrier();
+      apply_deg(id);
+      if (endloop < nloops)
+        barrier(); // before buckets are reused
+    }
+  }
+#elif defined SHARDED
+  // thread owning nonleaf bit w
+  u32 shard(const word_t w) const {
+    return ((u64)(w >> 6) * nthreads) >> (NONPART_BITS - 6);
+  }
+  // set n owned nonleaf bits, prefetching them all first
+  void set_shard(const word_t *ws, const u32 n) {
+    for (u32 i = 0; i < n; i++)
+      nonleaf.prefetch(ws[i]);
+    for (u32 i = 0; i < n; i++)
+      nonleaf.set_owned(ws[i]);
+  }
+  // set the nonleaf bits queued for thread id, returning their number
+  u32 drain_shards(const u32 id) {
+    u32 n = 0;
+    for (u32 t = 0; t < nthreads; t++)
+      n += queues[t * nthreads + id].drain([this](const word_t *ws, const u32 nw) { set_shard(ws, nw); });
+    return n;
+  }
+  // queue n endpoints from thread id to thread to, draining our own queues while full
+  void push_shard(const u32 id, const u32 to, const word_t *ws, const u32 n) {
+    while (!queues[id * nthreads + to].push(ws, n))
+      if (!drain_shards(id))
+        sched_yield();
+  }
+  // batch up endpoints in part for their owners, setting our own batches
+  void shard_deg(const u64 *hashes, const u32 nsiphash, const u32 part, const u32 id, word_t *out, u32 *nout) {
+    for (u32 i=0; i < nsiphash; i++) {
+      u64 u = hashes[i] & NODEMASK;
+      if ((u >> NONPART_BITS) == part) {
+        const word_t w = u & NONPART_MASK;
+        const u32 t = shard(w);
+        out[t * SHARD_BATCH + nout[t]++] = w;
+        if (nout[t] == SHARD_BATCH) {
+          if (t == id)
+            set_shard(out + t * SHARD_BATCH, SHARD_BATCH);
+          else push_shard(id, t, out + t * SHARD_BATCH, SHARD_BATCH);
+          nout[t] = 0;
+        }
+      }
+    }
+  }
+  void count_node_deg(const u32 id, const u32 uorv, const u32 part) {
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    std::vector<word_t> out(nthreads * SHARD_BATCH);
+    std::vector<u32> nout(nthreads, 0);
+    if (id == 0 && part == 0)
+      nonleaf.set_owned(0); // as set by the zero hashes of direct counting, keeping kill's dummy hashes harmless
+    u32 nidx = 0, nblocks = 0;
+    word_t nloops = NEDGES / 64 / nthreads;
+    for (word_t loop = alive.nextlive(id, 0); loop < nloops; loop = alive.nextlive(id, loop+1)) {
+      word_t block = 64 * (id + loop * nthreads);
+      u64 alive64 = alive.block(block);
+      for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
+        u32 ffs = __builtin_ffsll(alive64);
+        nonce += ffs; alive64 >>= ffs;
+        indices[nidx++] = 2*(u64)nonce + uorv;
+        if (nidx == NSIPHASH) {
+          siphash24xN(&sip_keys, indices, hashes);
+          shard_deg(hashes, NSIPHASH, part, id, out.data(), nout.data());
+          nidx = 0;
+        }
+        if (ffs & 64) break; // can't shift by 64
+      }
+      if (++nblocks % 64 == 0)
+        drain_shards(id); // keep queues to us from filling up
+    }
+    if (nidx) {
+      siphash24xN(&sip_keys, indices, hashes);
+      shard_deg(hashes, nidx, part, id, out.data(), nout.data());
+    }
+    set_shard(out.data() + id * SHARD_BATCH, nout[id]);
+    for (u32 t = 0; t < nthreads; t++)
+      if (t != id && nout[t])
+        push_shard(id, t, out.data() + t * SHARD_BATCH, nout[t]);
+    ndone.fetch_add(1, std::memory_order_release);
+    while (ndone.load(std::memory_order_acquire) < nthreads)
+      if (!drain_shards(id))
+        sched_yield();
+    drain_shards(id); // what was queued before the last thread finished
+  }
+#else
   void count_node_deg(const u32 id, const u32 uorv, const u32 part) {
     alignas(64) u64 indices[NSIPHASH];
     alignas(64) u64 hashes[NPREFETCH];
@@ -173,7 +478,7 @@ public:
     memset(hashes, 0, NPREFETCH * sizeof(u64)); // allow many nonleaf.set(0) to reduce branching
     u32 nidx = 0;
     word_t nloops = NEDGES / 64 / nthreads;
-    for (word_t loop = 0; loop < nloops; loop++) {
+    for (word_t loop = alive.nextlive(id, 0); loop < nloops; loop = alive.nextlive(id, loop+1)) {
       word_t block = 64 * (id + loop * nthreads);
       u64 alive64 = alive.block(block);
       for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
@@ -195,6 +500,7 @@ public:
       node_deg(hashes+(nidx&-NSIPHASH), nidx%NSIPHASH, part);
     }
   }
+#endif
   void kill_leaf_edges(const u32 id, const u32 uorv, const u32 part) {
     alignas(64) u64 indices[NPREFETCH];
     alignas(64) u64 hashes[NPREFETCH];
@@ -203,7 +509,7 @@ public:
       hashes[i] = 1; // allow many nonleaf.test(0) to reduce branching
     u32 nidx = 0;
     word_t nloops = NEDGES / 64 / nthreads;
-    for (word_t loop = 0; loop < nloops; loop++) {
+    for (word_t loop = alive.nextlive(id, 0); loop < nloops; loop = alive.nextlive(id, loop+1)) {
       word_t block = 64 * (id + loop * nthreads);
       u64 alive64 = alive.block(block);
       for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
@@ -249,8 +555,12 @@ void *worker(void *vp) {
     if (tp->id == 0) print_log("round %2d partition sizes", round);
 #endif
     for (u32 part = 0; part <= PART_MASK; part++) {
-      if (tp->id == 0)
+      if (tp->id == 0) {
         ctx->nonleaf.clear(); // clear all counts
+#ifdef SHARDED
+        ctx->ndone = 0;
+#endif
+      }
       ctx->barrier();
       ctx->count_node_deg(tp->id,round&1,part);
       ctx->barrier();
@@ -259,6 +569,7 @@ void *worker(void *vp) {
       if (tp->id == 0) print_log(" %c%d %llu", "UV"[round&1], part, alive.count());
 #endif
       ctx->barrier();
+      alive.summarize(tp->id);
     }
 #ifdef VERBOSE
     if (tp->id == 0) print_log("\n");
@@ -266,8 +577,15 @@ void *worker(void *vp) {
   }
   if (tp->id != 0)
     pthread_exit(NULL);
-  print_log("%d trims completed  %d edges left\n", round-1, alive.count());
+  print_log("%d trims completed  %llu edges left\n", round-1, alive.count());
+  if (alive.count() > MAXEDGES) { // would overflow the cycle finding data
+    print_log("too many edges left to find cycles\n");
+    pthread_exit(NULL);
+  }
+  const u64 rdtsc0 = __rdtsc();
   ctx->cg.reset();
+  word_t us[NPREFETCH], vs[NPREFETCH]; // edges whose nodes are compressed together
+  u32 nedges = 0;
   word_t nloops = NEDGES / 64;
   for (word_t loop = 0; loop < nloops; loop++) {
     word_t block = 64 * loop;
@@ -275,11 +593,17 @@ void *worker(void *vp) {
     for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
       u32 ffs = __builtin_ffsll(alive64);
       nonce += ffs; alive64 >>= ffs;
-      word_t u=sipnode(&ctx->sip_keys, nonce, 0), v=sipnode(&ctx->sip_keys, nonce, 1);
-      ctx->cg.add_compress_edge(u, v);
+      us[nedges] = sipnode(&ctx->sip_keys, nonce, 0);
+      vs[nedges] = sipnode(&ctx->sip_keys, nonce, 1);
+      if (++nedges == NPREFETCH) {
+        ctx->cg.add_compress_edges(us, vs, nedges);
+        nedges = 0;
+      }
       if (ffs & 64) break; // can't shift by 64
     }
   }
+  ctx->cg.add_compress_edges(us, vs, nedges);
+  print_log("findcycles rdtsc: %llu\n", __rdtsc() - rdtsc0);
   for (u32 s=0; s < ctx->cg.nsols; s++) {
     u32 j = 0, nalive = 0;
     word_t nloops = NEDGES / 64;
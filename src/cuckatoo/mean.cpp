@@ -3,13 +3,117 @@
 
 #include "mean.hpp"
 #include <unistd.h>
+#include <atomic>
 
 // arbitrary length of header hashed into siphash key
 #define HEADERLEN 80
 
-typedef solver_ctx SolverCtx;
+// one or more solver_ctx, each with its own threads and memory, trimming
+// different nonces at once. a single trimmer stops scaling at a few dozen
+// threads, as ever more of its time goes to waiting at per row barriers.
+struct solver_group {
+  std::vector<solver_ctx *> ctxs;
+  thread_pool *lanes; // runs one thread per ctx if there are several
+  std::atomic<u32> next; // next nonce to claim, relative to nonce
+  std::atomic<bool> stopped;
+  pthread_mutex_t mutex; // for reporting solutions and stats
+  // arguments of the run_solver in progress
+  const char *header;
+  int header_length;
+  u32 nonce;
+  u32 range;
+  SolverSolutions *solutions;
+  SolverStats *stats;
+  u32 sumnsols;
 
-CALL_CONVENTION int run_solver(SolverCtx* ctx,
+  solver_group() {
+    lanes = 0;
+    stopped = false;
+    pthread_mutex_init(&mutex, 0);
+  }
+  ~solver_group() {
+    delete lanes;
+    for (u32 i = 0; i < ctxs.size(); i++)
+      delete ctxs[i];
+    pthread_mutex_destroy(&mutex);
+  }
+  u64 sharedbytes() const {
+    return ctxs.size() * solver_ctx::sharedbytes();
+  }
+  u32 threadbytes() const {
+    return solver_ctx::threadbytes();
+  }
+  void abort() {
+    stopped = true;
+    for (u32 i = 0; i < ctxs.size(); i++)
+      ctxs[i]->abort();
+  }
+};
+
+typedef solver_group SolverCtx;
+
+// print, verify, and pass on to the caller the nsols solutions in ctx->sols
+void reportsols(solver_ctx *ctx, const u32 solnonce, siphash_keys *solkeys, const u32 nsols, SolverSolutions *solutions, u32 &sumnsols) {
+  for (unsigned s = 0; s < nsols; s++) {
+    print_log("Solution");
+    word_t *prf = &ctx->sols[s * PROOFSIZE];
+    for (u32 i = 0; i < PROOFSIZE; i++)
+      print_log(" %jx", (uintmax_t)prf[i]);
+    print_log("\n");
+    if (solutions != NULL && sumnsols+s < MAX_SOLS) {
+      solutions->edge_bits = EDGEBITS;
+      solutions->num_sols++;
+      solutions->sols[sumnsols+s].nonce = solnonce;
+      for (u32 i = 0; i < PROOFSIZE; i++) 
+        solutions->sols[sumnsols+s].proof[i] = (u64) prf[i];
+    }
+    int pow_rc = verify(prf, solkeys);
+    if (pow_rc == POW_OK) {
+      print_log("Verified with cyclehash ");
+      unsigned char cyclehash[32];
+      blake2b((void *)cyclehash, sizeof(cyclehash), (const void *)prf, sizeof(proof), 0, 0);
+      for (int i=0; i<32; i++)
+        print_log("%02x", cyclehash[i]);
+      print_log("\n");
+    } else {
+      print_log("FAILED due to %s\n", errstr[pow_rc]);
+    }
+  }
+  sumnsols += nsols;
+}
+
+void reportstats(SolverStats *stats, const u64 time0, const u64 time1) {
+  if (stats != NULL) {
+      stats->device_id = 0;
+      stats->edge_bits = EDGEBITS;
+      strncpy(stats->device_name, "CPU\0", MAX_NAME_LEN);
+      stats->last_start_time = time0;
+      stats->last_end_time = time1;
+      stats->last_solution_time = time1 - time0;
+  }
+}
+
+// each lane claims nonces until none are left, and reports solutions
+// in the order that it finds them
+void laneworker(void *vp, const unsigned id) {
+  solver_group *grp = (solver_group *)vp;
+  solver_ctx *ctx = grp->ctxs[id];
+  std::vector<char> headernonce(grp->header, grp->header + grp->header_length);
+  for (u32 r; !grp->stopped && (r = grp->next++) < grp->range; ) {
+    const u64 time0 = timestamp();
+    ctx->setheadernonce(headernonce.data(), grp->header_length, grp->nonce + r);
+    const u32 nsols = ctx->solve();
+    const u64 time1 = timestamp();
+    pthread_mutex_lock(&grp->mutex);
+    print_log("nonce %d k0 k1 k2 k3 %llx %llx %llx %llx\n", grp->nonce+r, ctx->trimmer.sip_keys.k0, ctx->trimmer.sip_keys.k1, ctx->trimmer.sip_keys.k2, ctx->trimmer.sip_keys.k3);
+    print_log("Time: %d ms on lane %d\n", (u32)((time1 - time0) / 1000000), id);
+    reportsols(ctx, grp->nonce + r, &ctx->trimmer.sip_keys, nsols, grp->solutions, grp->sumnsols);
+    reportstats(grp->stats, time0, time1);
+    pthread_mutex_unlock(&grp->mutex);
+  }
+}
+
+CALL_CONVENTION int run_solver(SolverCtx* grp,
                                char* header,
                                int header_length,
                                u32 nonce,
@@ -18,53 +122,43 @@ CALL_CONVENTION int run_solver(SolverCtx* ctx,
                                SolverStats *stats
                                )
 {
+  if (grp->lanes) {
+    grp->header = header;
+    grp->header_length = header_length;
+    grp->nonce = nonce;
+    grp->range = range;
+    grp->solutions = solutions;
+    grp->stats = stats;
+    grp->sumnsols = 0;
+    grp->next = 0;
+    grp->stopped = false;
+    grp->lanes->run(laneworker, (void *)grp);
+    print_log("%d total solutions\n", grp->sumnsols);
+    return grp->sumnsols > 0;
+  }
+  solver_ctx *ctx = grp->ctxs[0];
   u64 time0, time1;
   u32 timems;
   u32 sumnsols = 0;
+  // a pipelined solver reports solutions for each nonce one iteration later
+  const u32 lag = ctx->pipeline;
 
-  for (u32 r = 0; r < range; r++) {
+  for (u32 r = 0; r < range + lag; r++) {
     time0 = timestamp();
-    ctx->setheadernonce(header, header_length, nonce + r);
-    print_log("nonce %d k0 k1 k2 k3 %llx %llx %llx %llx\n", nonce+r, ctx->trimmer.sip_keys.k0, ctx->trimmer.sip_keys.k1, ctx->trimmer.sip_keys.k2, ctx->trimmer.sip_keys.k3);
-    u32 nsols = ctx->solve();
+    if (r < range) {
+      ctx->setheadernonce(header, header_length, nonce + r);
+      print_log("nonce %d k0 k1 k2 k3 %llx %llx %llx %llx\n", nonce+r, ctx->trimmer.sip_keys.k0, ctx->trimmer.sip_keys.k1, ctx->trimmer.sip_keys.k2, ctx->trimmer.sip_keys.k3);
+    }
+    u32 nsols = lag ? ctx->solve_pipelined(r == range) : ctx->solve();
     time1 = timestamp();
     timems = (time1 - time0) / 1000000;
     print_log("Time: %d ms\n", timems);
-
-    for (unsigned s = 0; s < nsols; s++) {
-      print_log("Solution");
-      word_t *prf = &ctx->sols[s * PROOFSIZE];
-      for (u32 i = 0; i < PROOFSIZE; i++)
-        print_log(" %jx", (uintmax_t)prf[i]);
-      print_log("\n");
-      if (solutions != NULL){
-        solutions->edge_bits = EDGEBITS;
-        solutions->num_sols++;
-        solutions->sols[sumnsols+s].nonce = nonce + r;
-        for (u32 i = 0; i < PROOFSIZE; i++) 
-          solutions->sols[sumnsols+s].proof[i] = (u64) prf[i];
-      }
-      int pow_rc = verify(prf, &ctx->trimmer.sip_keys);
-      if (pow_rc == POW_OK) {
-        print_log("Verified with cyclehash ");
-        unsigned char cyclehash[32];
-        blake2b((void *)cyclehash, sizeof(cyclehash), (const void *)prf, sizeof(proof), 0, 0);
-        for (int i=0; i<32; i++)
-          print_log("%02x", cyclehash[i]);
-        print_log("\n");
-      } else {
-        print_log("FAILED due to %s\n", errstr[pow_rc]);
-      }
-    }
-    sumnsols += nsols;
-    if (stats != NULL) {
-        stats->device_id = 0;
-        stats->edge_bits = EDGEBITS;
-        strncpy(stats->device_name, "CPU\0", MAX_NAME_LEN);
-        stats->last_start_time = time0;
-        stats->last_end_time = time1;
-        stats->last_solution_time = time1 - time0;
-    }
+    if (r < lag)
+      continue;
+    const u32 solnonce = nonce + r - lag;
+    siphash_keys *solkeys = lag ? &ctx->solkeys : &ctx->trimmer.sip_keys;
+    reportsols(ctx, solnonce, solkeys, nsols, solutions, sumnsols);
+    reportstats(stats, time0, time1);
   }
   print_log("%d total solutions\n", sumnsols);
   return sumnsols > 0;
@@ -74,12 +168,33 @@ CALL_CONVENTION SolverCtx* create_solver_ctx(SolverParams* params) {
   if (params->nthreads == 0) params->nthreads = 1;
   if (params->ntrims == 0) params->ntrims = EDGEBITS >= 30 ? 96 : 68;
 
-  SolverCtx* ctx = new SolverCtx(params->nthreads,
+  // as many lanes as fit in the budget, sharing the threads as evenly as
+  // possible. buckets in a file take memory only once moved there
+  u32 nlanes = std::max(1u, std::min(params->nonces, params->nthreads));
+  const u64 budget = (u64)params->budgetmb << 20;
+  const u64 lanebytes = params->bucketdir ? (u64)params->bucketmb << 20 : solver_ctx::sharedbytes();
+  while (nlanes > 1 && budget && nlanes * lanebytes + params->nthreads * (u64)solver_ctx::threadbytes() > budget)
+    nlanes--;
+  // lanes already overlap cycle finding with trimming, and would share cpus
+  const bool single = nlanes == 1;
+
+  SolverCtx* grp = new SolverCtx;
+  for (u32 i = 0; i < nlanes; i++)
+    grp->ctxs.push_back(new solver_ctx(params->nthreads / nlanes + (i < params->nthreads % nlanes),
                                  params->ntrims,
+                                 params->trimstop,
+                                 params->tailedges,
                                  params->allrounds,
                                  params->showcycle,
-                                 params->mutate_nonce);
-  return ctx;
+                                 params->mutate_nonce,
+                                 single && params->pipeline,
+                                 (hugepage_mode)params->hugepages,
+                                 single && params->numa,
+                                 params->bucketdir,
+                                 params->bucketmb));
+  if (!single)
+    grp->lanes = new thread_pool(nlanes);
+  return grp;
 }
 
 CALL_CONVENTION void destroy_solver_ctx(SolverCtx* ctx) {
@@ -94,6 +209,7 @@ CALL_CONVENTION void fill_default_params(SolverParams* params) {
 	// not required in this solver
 }
 
+#ifndef SOLVER_ENGINE
 int main(int argc, char **argv) {
   u32 nthreads = 0;
   u32 ntrims = 0;
@@ -107,19 +223,44 @@ int main(int argc, char **argv) {
   char header[HEADERLEN];
   u32 len;
   bool allrounds = false;
+  bool pipeline = false;
+  u32 hugepages = HUGE_NONE;
+  bool numa = false;
+  u32 trimstop = 0;
+  u32 tailedges = 0;
+  const char *bucketdir = 0;
+  u32 bucketmb = 0;
+  u32 nonces = 1;
+  u32 budgetmb = 0;
   int c;
 
   memset(header, 0, sizeof(header));
-  while ((c = getopt (argc, argv, "ah:m:n:r:st:x:")) != -1) {
+  while ((c = getopt (argc, argv, "aA:b:B:f:h:H:k:m:M:n:Npr:st:x:")) != -1) {
     switch (c) {
       case 'a':
         allrounds = true;
         break;
+      case 'A':
+        trimstop = atoi(optarg);
+        break;
+      case 'b':
+        tailedges = atoi(optarg);
+        break;
+      case 'B':
+        budgetmb = atoi(optarg);
+        break;
+      case 'f':
+        bucketdir = optarg;
+        break;
       case 'h':
         len = strlen(optarg);
         assert(len <= sizeof(header));
         memcpy(header, optarg, len);
         break;
+      case 'H':
+        hugepages = atoi(optarg);
+        assert(hugepages <= HUGE_1GB);
+        break;
       case 'x':
         len = strlen(optarg)/2;
         assert(len == sizeof(header));
@@ -129,12 +270,24 @@ int main(int argc, char **argv) {
       case 'n':
         nonce = atoi(optarg);
         break;
+      case 'N':
+        numa = true;
+        break;
+      case 'p':
+        pipeline = true;
+        break;
       case 'r':
         range = atoi(optarg);
         break;
+      case 'k':
+        nonces = atoi(optarg);
+        break;
       case 'm':
         ntrims = atoi(optarg) & -2; // make even as required by solve()
         break;
+      case 'M':
+        bucketmb = atoi(optarg);
+        break;
       case 's':
         showcycle = true;
         break;
@@ -149,8 +302,18 @@ int main(int argc, char **argv) {
   params.ntrims = ntrims;
   params.showcycle = showcycle;
   params.allrounds = allrounds;
+  params.pipeline = pipeline;
+  params.hugepages = hugepages;
+  params.numa = numa;
+  params.trimstop = trimstop;
+  params.tailedges = tailedges;
+  params.bucketdir = bucketdir;
+  params.bucketmb = bucketmb;
+  params.nonces = nonces;
+  params.budgetmb = budgetmb;
 
-  SolverCtx* ctx = create_solver_ctx(&params);
+  SolverCtx* grp = create_solver_ctx(&params);
+  const solver_ctx *ctx = grp->ctxs[0];
 
   print_log("Looking for %d-cycle on cuckatoo%d(\"%s\",%d", PROOFSIZE, EDGEBITS, header, nonce);
   if (range > 1)
@@ -162,11 +325,25 @@ int main(int argc, char **argv) {
   int sunit,tunit;
   for (sunit=0; sbytes >= 10240; sbytes>>=10,sunit++) ;
   for (tunit=0; tbytes >= 10240; tbytes>>=10,tunit++) ;
-  print_log("Using %d%cB bucket memory at %lx,\n", sbytes, " KMGT"[sunit], (u64)ctx->trimmer.buckets);
-  print_log("%dx%d%cB thread memory at %lx,\n", params.nthreads, tbytes, " KMGT"[tunit], (u64)ctx->trimmer.tbuckets);
+  if (bucketdir) {
+    print_log("Using %d%cB bucket file in %s", sbytes, " KMGT"[sunit], bucketdir);
+    if (bucketmb)
+      print_log(", moving to memory below %dMB", bucketmb);
+    print_log(",\n");
+  } else print_log("Using %d%cB bucket memory at %lx with %s,\n", sbytes, " KMGT"[sunit], (u64)ctx->trimmer.buckets, hugepage_names[ctx->trimmer.bucketpages]);
+  print_log("%dx%d%cB thread memory at %lx with %s,\n", params.nthreads, tbytes, " KMGT"[tunit], (u64)ctx->trimmer.tbuckets, hugepage_names[ctx->trimmer.tbucketpages]);
   print_log("%d-way siphash, and %d buckets.\n", NSIPHASH, NX);
+  if (ctx->trimmer.numa)
+    print_log("Threads pinned to %d cpus in numa node order.\n", (int)ctx->trimmer.cpus.size());
+  if (grp->ctxs.size() > 1) {
+    print_log("Trimming %d nonces at a time, each with its own buckets, on", (int)grp->ctxs.size());
+    for (u32 i = 0; i < grp->ctxs.size(); i++)
+      print_log(" %d", grp->ctxs[i]->trimmer.nthreads);
+    print_log(" threads.\n");
+  }
 
-	run_solver(ctx, header, sizeof(header), nonce, range, NULL, NULL);
+	run_solver(grp, header, sizeof(header), nonce, range, NULL, NULL);
 
-	destroy_solver_ctx(ctx);
+	destroy_solver_ctx(grp);
 }
+#endif
@@ -16,8 +16,12 @@
 #include <assert.h>
 #include <vector>
 #include <bitset>
+#include <atomic>
 #include "graph.hpp"
+#include "hugepages.hpp"
 #include "../threads/barrier.hpp"
+#include "../threads/pool.hpp"
+#include "../threads/affinity.hpp"
 
 // algorithm/performance parameters
 
@@ -49,6 +53,13 @@
 #define XBITS 7
 #endif
 
+// NSIPHASH 4, and 8 with avx2, have their siphash rounds inlined below.
+// other widths compute batches of NSIPHASH endpoints with siphash24xN,
+// e.g. 8 without avx2, which interleaves sse2 and scalar lanes, or 16 with avx2
+#if !(NSIPHASH == 4 || (NSIPHASH == 8 && defined __AVX2__))
+#define SIPHASH_BATCH
+#endif
+
 #define YBITS XBITS
 
 // size in bytes of a big bucket entry
@@ -77,9 +88,13 @@
 #endif
 #endif
 // but they may need syncing entries
-#if BIGSIZE0 == 4 && EDGEBITS > 27
+#if BIGSIZE0 == 4 && EDGEBITS > 27 && !defined COMPACT0
 #define NEEDSYNC
 #endif
+// with COMPACT0, initial entries are only the 16 bit gaps between
+// successive edges of a bucket, leaving genVnodes to recompute their
+// U endpoints. peak memory use then moves to the BIGSIZE entries of
+// the edges that survive genVnodes, which is 2/3 of that for BIGSIZE0 5
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -159,6 +174,8 @@ const u32 NTRIMMEDZ  = NZ * TRIMFRAC256 / 256;
 const u32 ZBUCKETSLOTS = NZ + NZ * BIGEPS;
 #ifdef SAVEEDGES
 const u32 ZBUCKETSIZE = NTRIMMEDZ * (BIGSIZE + sizeof(u32));  // assumes EDGEBITS <= 32
+#elif defined COMPACT0
+const u32 ZBUCKETSIZE = NTRIMMEDZ * BIGSIZE;
 #else
 const u32 ZBUCKETSIZE = ZBUCKETSLOTS * BIGSIZE0; 
 #endif
@@ -226,18 +243,116 @@ struct indexer {
       sumsize += buckets[x][y].setsize(base+index[y]);
     return sumsize;
   }
+  // append entry e, of which only the first size bytes matter, to bucket i
+  template<typename T>
+  void store(u8 const *base, const u32 i, const T e, const u32 size) {
+    *(T *)(base+index[i]) = e;
+    index[i] += size;
+  }
+};
+
+#ifdef WCBUFFER
+// software write combining of the big bucket scatter. rather than having
+// NX partially written cache lines compete for L1, and every store miss
+// read the line it is about to overwrite, entries are staged per bucket in
+// a line sized buffer that is written out with non-temporal stores when full.
+// a bucket's first and last lines are partial and shared with its
+// neighbours, so those get written with regular stores of only our bytes.
+template<u32 BUCKETSIZE>
+struct wcindexer : indexer<BUCKETSIZE> {
+  using indexer<BUCKETSIZE>::index;
+  static const u32 LINESIZE = 64;
+  offset_t start[NX];
+  u8 lines[NX][LINESIZE + sizeof(u64)]; // room for a store crossing the line
+
+  void begin() {
+    for (u32 i = 0; i < NX; i++)
+      start[i] = index[i];
+  }
+  void matrixv(const u32 y) {
+    indexer<BUCKETSIZE>::matrixv(y);
+    begin();
+  }
+  void matrixu(const u32 x) {
+    indexer<BUCKETSIZE>::matrixu(x);
+    begin();
+  }
+  // write out the bytes of the line holding index[i] that belong to bucket i
+  void flushline(u8 const *base, const u32 i, const offset_t end) {
+    const offset_t line = index[i] & ~(offset_t)(LINESIZE-1);
+    if (line >= start[i] && end == line + LINESIZE) {
+      __m128i *to = (__m128i *)(base+line);
+      for (u32 j = 0; j < LINESIZE/16; j++)
+        _mm_stream_si128(to + j, _mm_loadu_si128((__m128i *)(lines[i] + 16*j)));
+    } else {
+      const offset_t from = std::max(line, start[i]);
+      memcpy((u8 *)base+from, lines[i] + from % LINESIZE, end - from);
+    }
+  }
+  template<typename T>
+  void store(u8 const *base, const u32 i, const T e, const u32 size) {
+    const u32 off = index[i] % LINESIZE;
+    *(T *)(lines[i] + off) = e;
+    if (off + size >= LINESIZE) {
+      flushline(base, i, (index[i] & ~(offset_t)(LINESIZE-1)) + LINESIZE);
+      *(u64 *)lines[i] = *(u64 *)(lines[i] + LINESIZE);
+    }
+    index[i] += size;
+  }
+  void flush(u8 const *base) {
+    for (u32 i = 0; i < NX; i++)
+      if (index[i] % LINESIZE)
+        flushline(base, i, index[i]);
+    _mm_sfence(); // order streamed lines before the barrier that publishes them
+  }
+  offset_t storev(yzbucket<BUCKETSIZE> *buckets, const u32 y) {
+    flush((u8 *)buckets);
+    return indexer<BUCKETSIZE>::storev(buckets, y);
+  }
+  offset_t storeu(yzbucket<BUCKETSIZE> *buckets, const u32 x) {
+    flush((u8 *)buckets);
+    return indexer<BUCKETSIZE>::storeu(buckets, x);
+  }
 };
 
+typedef wcindexer<ZBUCKETSIZE> bigindexer;
+#else
+typedef indexer<ZBUCKETSIZE> bigindexer;
+#endif
+
 #define likely(x)   __builtin_expect((x)!=0, 1)
 #define unlikely(x) __builtin_expect((x), 0)
 
-class edgetrimmer; // avoid circular references
+#ifdef COMPACT0
+// append the positive gap between successive edges to bucket i, preceded
+// by a zero entry for every 0xffff edges that the gap exceeds 0xffff by
+template<class INDEXER>
+void storegap(INDEXER &dst, u8 const *base, const u32 i, u32 gap) {
+  for (; unlikely(gap > 0xffff); gap -= 0xffff)
+    dst.store(base, i, (u16)0, sizeof(u16));
+  dst.store(base, i, (u16)gap, sizeof(u16));
+}
+#endif
 
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  edgetrimmer *et;
-} thread_ctx;
+#ifdef __AVX2__
+// lane permutations that move the 32-bit lanes selected by an 8 bit mask to
+// the front, in order, as 8 byte sized lane indices per mask
+struct leftpacker {
+  u64 perm[256];
+  leftpacker() {
+    for (u32 m = 0; m < 256; m++) {
+      perm[m] = 0;
+      for (u32 i = 0, n = 0; i < 8; i++)
+        if (m >> i & 1)
+          perm[m] |= (u64)i << (8 * n++);
+    }
+  }
+  __m256i operator()(const __m256i v, const u32 m) const {
+    return _mm256_permutevar8x32_epi32(v, _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(perm[m])));
+  }
+};
+static const leftpacker leftpack;
+#endif
 
 typedef u8 zbucket8[NYZ1];
 typedef u16 zbucket16[NTRIMMEDZ];
@@ -249,48 +364,165 @@ public:
   siphash_keys sip_keys;
   yzbucket<ZBUCKETSIZE> *buckets;
   yzbucket<TBUCKETSIZE> *tbuckets;
+  hugepage_mode bucketpages;  // page size actually used for buckets
+  hugepage_mode tbucketpages; // and for tbuckets
+  // optionally, buckets start out in a file, and move to memory once
+  // they fit in bucketmem bytes
+  yzbucket<ZBUCKETSIZE> *filebuckets;
+  yzbucket<ZBUCKETSIZE> *membuckets;
+  int bucketfd;
+  u64 bucketmem;
+  bool clearfailed; // to warn only once
   zbucket32 *tedges;
   zbucket16 *tzs;
   zbucket8 *tdegs;
   offset_t *tcounts;
+  u32 *tmaxsizes; // largest row or column in last trimedges1 round
+  // rdtsc at which each thread finished its last round, double buffered
+  // so that showtail can read them while the next round is under way
+  u64 *tdone;
+  // rounds without a per row barrier have threads claim their rows (or
+  // columns) one at a time, so that a slow thread holds up no one else.
+  // counters alternate between rounds, the next one being reset during
+  // the current one, which lies between barriers on either side
+  struct rowcounter {
+    std::atomic<u32> next;
+    char pad[64 - sizeof(std::atomic<u32>)];
+  } rowcounters[2];
+  // per thread count and largest row or column size after a pair of
+  // trimedges1 rounds, double buffered so that all threads read the same
+  struct paircount {
+    offset_t count;
+    u32 maxsize;
+  } *paircounts;
   u32 ntrims;
+  u32 trimstop;  // adaptive: stop once a round removes under trimstop/1024 of edges
+  u32 tailedges; // or once at most this many edges remain
   u32 nthreads;
   bool showall;
-  thread_ctx *threads;
+  bool numa;
+  std::vector<int> cpus; // to pin threads to in numa mode
   trim_barrier barry;
 
   void touch(u8 *p, const offset_t n) {
     for (offset_t i=0; i<n; i+=4096)
       *(u32 *)(p+i) = 0;
   }
-  edgetrimmer(const u32 n_threads, const u32 n_trims, const bool show_all) : barry(n_threads) {
+  edgetrimmer(const u32 n_threads, const u32 n_trims, const u32 trim_stop, const u32 tail_edges, const bool show_all, const hugepage_mode huge_pages, const bool numa_mode, const char *bucket_dir = 0, const u32 bucket_mb = 0) : barry(n_threads) {
     assert(sizeof(matrix<ZBUCKETSIZE>) == NX * sizeof(yzbucket<ZBUCKETSIZE>));
     assert(sizeof(matrix<TBUCKETSIZE>) == NX * sizeof(yzbucket<TBUCKETSIZE>));
     nthreads = n_threads;
     ntrims   = n_trims;
+    trimstop = trim_stop;
+    tailedges = tail_edges;
     showall = show_all;
-    buckets  = new yzbucket<ZBUCKETSIZE>[NX];
-    touch((u8 *)buckets, sizeof(matrix<ZBUCKETSIZE>));
-    tbuckets = new yzbucket<TBUCKETSIZE>[nthreads];
-    touch((u8 *)tbuckets, sizeof(yzbucket<TBUCKETSIZE>[nthreads]));
+    numa = numa_mode && !bucket_dir;
+    if (numa)
+      cpus = numa_cpus();
+    bucketpages = tbucketpages = huge_pages;
+    filebuckets = membuckets = 0;
+    bucketfd = -1;
+    clearfailed = false;
+    bucketmem = (u64)bucket_mb << 20;
+    if (bucket_dir) {
+      buckets = filebuckets = (yzbucket<ZBUCKETSIZE> *)filemap_alloc(bucket_dir, sizeof(matrix<ZBUCKETSIZE>), bucketfd);
+      if (!buckets) {
+        print_log("cannot create a %lu byte bucket file in %s: %s\n", sizeof(matrix<ZBUCKETSIZE>), bucket_dir, strerror(errno));
+        exit(1);
+      }
+      // membuckets only take memory as they get written, unlike reserved huge pages
+      bucketpages = std::min(bucketpages, HUGE_THP);
+      if (bucket_mb) {
+        membuckets = (yzbucket<ZBUCKETSIZE> *)hugepage_alloc(sizeof(matrix<ZBUCKETSIZE>), bucketpages);
+        assert(membuckets);
+      }
+    } else {
+      buckets = (yzbucket<ZBUCKETSIZE> *)hugepage_alloc(sizeof(matrix<ZBUCKETSIZE>), bucketpages);
+      assert(buckets);
+    }
+    tbuckets = (yzbucket<TBUCKETSIZE> *)hugepage_alloc(nthreads * sizeof(yzbucket<TBUCKETSIZE>), tbucketpages);
+    assert(tbuckets);
+    if (!numa) { // else left to numatouch
+      if (!filebuckets)
+        touch((u8 *)buckets, sizeof(matrix<ZBUCKETSIZE>));
+      touch((u8 *)tbuckets, sizeof(yzbucket<TBUCKETSIZE>[nthreads]));
+    }
 #ifdef SAVEEDGES
     tedges  = 0;
 #else
     tedges  = new zbucket32[nthreads];
 #endif
-    tdegs   = new zbucket8[nthreads];
+    tdegs   = new zbucket8[nthreads+1]; // spare for avx2 gathers reading past the end
     tzs     = new zbucket16[nthreads];
     tcounts = new offset_t[nthreads];
-    threads = new thread_ctx[nthreads];
+    tmaxsizes = new u32[nthreads];
+    tdone = new u64[2 * nthreads];
+    paircounts = new paircount[2 * nthreads];
   }
   ~edgetrimmer() {
-    delete[] threads;
-    delete[] buckets;
-    delete[] tbuckets;
+    if (filebuckets) {
+      filemap_free(filebuckets, sizeof(matrix<ZBUCKETSIZE>), bucketfd);
+      hugepage_free(membuckets, sizeof(matrix<ZBUCKETSIZE>), bucketpages);
+    } else hugepage_free(buckets, sizeof(matrix<ZBUCKETSIZE>), bucketpages);
+    hugepage_free(tbuckets, nthreads * sizeof(yzbucket<TBUCKETSIZE>), tbucketpages);
     delete[] tedges;
     delete[] tdegs;
     delete[] tzs;
     delete[] tcounts;
+    delete[] tmaxsizes;
+    delete[] tdone;
+    delete[] paircounts;
+  }
+  void pin(const u32 id) {
+    pin_thread(thread_cpu(cpus, id, nthreads));
+  }
+  // in numa mode, threads with consecutive ids run on one node, and own
+  // consecutive rows ux and columns vx of buckets, trimming on u in rows
+  // and on v in columns. buckets[ux][vx] whose row and column share an owner
+  // are placed on its node and stay local in all rounds. the others are
+  // written from one node in u rounds and from another in v rounds, so we
+  // alternate between placing them with their row and with their column.
+  void numatouch(const u32 id) {
+    pin(id);
+    const u32 startx = NX *  id    / nthreads;
+    const u32   endx = NX * (id+1) / nthreads;
+    for (u32 ux = 0; ux < NX; ux++) {
+      for (u32 vx = 0; vx < NY; vx++) {
+        const u32 owner = (ux ^ vx) & 1 ? ux : vx;
+        if (owner >= startx && owner < endx)
+          touch(buckets[ux][vx].bytes, sizeof(zbucket<ZBUCKETSIZE>));
+      }
+    }
+    touch((u8 *)tbuckets[id], sizeof(yzbucket<TBUCKETSIZE>));
+  }
+  // the first row for thread id to trim in round, or NY if there is none.
+  // in numa mode, threads stick to the rows they placed in their own node
+  u32 firstrow(const u32 id, const u32 round) {
+    if (numa) {
+      const u32 row = NY * id / nthreads;
+      return row < NY * (id+1) / nthreads ? row : NY;
+    }
+    if (!id)
+      rowcounters[(round+1) & 1].next.store(0, std::memory_order_relaxed);
+    return std::min(rowcounters[round & 1].next.fetch_add(1, std::memory_order_relaxed), NY);
+  }
+  // the row to trim after row, or NY if there is none
+  u32 nextrow(const u32 id, const u32 round, const u32 row) {
+    if (numa)
+      return row+1 < NY * (id+1) / nthreads ? row+1 : NY;
+    return std::min(rowcounters[round & 1].next.fetch_add(1, std::memory_order_relaxed), NY);
+  }
+  // after the barrier ending round, how long its first finisher waited for the last
+  void showtail(const u32 id, const u32 round) const {
+    if (!showall || id)
+      return;
+    const u64 *done = tdone + (round & 1) * nthreads;
+    u64 first = done[0], last = done[0];
+    for (u32 t = 1; t < nthreads; t++) {
+      first = std::min(first, done[t]);
+      last  = std::max(last,  done[t]);
+    }
+    print_log("round %2d tail rdtsc: %lu\n", round, last - first);
   }
   offset_t count() const {
     offset_t cnt = 0;
@@ -298,20 +530,44 @@ public:
       cnt += tcounts[t];
     return cnt;
   }
+  // with buckets in a file, how many of their first bytes to read ahead,
+  // given the count and entry size of the previous round. buckets fill
+  // evenly, so this is a little over their average size
+  u32 aheadbytes(const u32 size) const {
+    const u64 avg = (u64)count() * size / (NX * NY);
+    return std::min(avg + avg / 8 + 4096, (u64)sizeof(zbucket<ZBUCKETSIZE>));
+  }
+  // discard the contents of the bucket file
+  void clearfile() {
+    if (!filemap_clear(bucketfd, sizeof(matrix<ZBUCKETSIZE>)) && !clearfailed) {
+      print_log("bucket file pages cannot be released: %s\n", strerror(errno));
+      clearfailed = true;
+    }
+  }
+  // start reading in row x, or column x, of the buckets in a file
+  void readahead(const u32 x, const bool column, const u32 bytes) const {
+    if (buckets != filebuckets)
+      return;
+    for (u32 i = 0; i < NX; i++)
+      filemap_willneed(column ? &buckets[i][x] : &buckets[x][i], bytes);
+  }
 
   void genUnodes(const u32 id, const u32 uorv) {
     u64 rdtsc0, rdtsc1;
-#ifdef NEEDSYNC
-    u32 last[NX];;
+#if defined NEEDSYNC || defined COMPACT0
+    u32 last[NX];
 #endif
   
     rdtsc0 = __rdtsc();
     u8 const *base = (u8 *)buckets;
-    indexer<ZBUCKETSIZE> dst;
+    bigindexer dst;
     const u32 starty = NY *  id    / nthreads;
     const u32   endy = NY * (id+1) / nthreads;
     u32 edge = starty << YZBITS, endedge = edge + NYZ;
-#if NSIPHASH == 4
+#ifdef SIPHASH_BATCH
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+#elif NSIPHASH == 4
     const __m128i vxmask = _mm_set1_epi64x(XMASK);
     const __m128i vyzmask = _mm_set1_epi64x(YZMASK);
     __m128i v0, v1, v2, v3, v4, v5, v6, v7;
@@ -344,28 +600,39 @@ public:
 #ifdef NEEDSYNC
       for (u32 x=0; x < NX; x++)
         last[x] = edge;
+#elif defined COMPACT0
+      for (u32 x=0; x < NX; x++)
+        last[x] = edge - 1; // making all gaps positive
 #endif
       for (; edge < endedge; edge += NSIPHASH) {
 // bit        28..21     20..13    12..0
 // node       XXXXXX     YYYYYY    ZZZZZ
-#if NSIPHASH == 1
-        const u32 node = sipnode(&sip_keys, edge, uorv);
-        const u32 ux = node >> YZBITS;
-        const BIGTYPE0 zz = (BIGTYPE0)edge << YZBITS | (node & YZMASK);
+#ifdef SIPHASH_BATCH
+        for (u32 i = 0; i < NSIPHASH; i++)
+          indices[i] = 2 * (u64)(edge + i) + uorv;
+        siphash24xN(&sip_keys, indices, hashes);
+        for (u32 i = 0; i < NSIPHASH; i++) {
+          const u32 node = hashes[i] & NODEMASK;
+          const u32 ux = node >> YZBITS;
+#ifdef COMPACT0
+          storegap(dst, base, ux, edge + i - last[ux]);
+          last[ux] = edge + i;
+#else
+          const BIGTYPE0 zz = (BIGTYPE0)(edge + i) << YZBITS | (node & YZMASK);
 #ifndef NEEDSYNC
 // bit        39..21     20..13    12..0
 // write        edge     YYYYYY    ZZZZZ
-        *(BIGTYPE0 *)(base+dst.index[ux]) = zz;
-        dst.index[ux] += BIGSIZE0;
+          dst.store(base, ux, zz, BIGSIZE0);
 #else
-        if (zz) {
-          for (; unlikely(last[ux] + NNONYZ <= edge); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)
-            *(u32 *)(base+dst.index[ux]) = 0;
-          *(u32 *)(base+dst.index[ux]) = zz;
-          dst.index[ux] += BIGSIZE0;
-          last[ux] = edge;
-        }
+          if (zz) {
+            for (; unlikely(last[ux] + NNONYZ <= edge + i); last[ux] += NNONYZ)
+              dst.store(base, ux, (u32)0, BIGSIZE0);
+            dst.store(base, ux, (u32)zz, BIGSIZE0);
+            last[ux] = edge + i;
+          }
+#endif
 #endif
+        }
 #elif NSIPHASH == 4
         v7 = v3 = _mm_set1_epi64x(sip_keys.k3);
         v4 = v0 = _mm_set1_epi64x(sip_keys.k0);
@@ -396,21 +663,24 @@ public:
 #else
 #define extract32(x, imm) _mm_extract_epi32(x, imm)
 #endif
-#ifndef NEEDSYNC
+#ifdef COMPACT0
 #define STORE0(i,v,x,w) \
   ux = extract32(v,x);\
-  *(u64 *)(base+dst.index[ux]) = _mm_extract_epi64(w,i%2);\
-  dst.index[ux] += BIGSIZE0;
+  storegap(dst, base, ux, edge+i - last[ux]);\
+  last[ux] = edge+i;
+#elif !defined NEEDSYNC
+#define STORE0(i,v,x,w) \
+  ux = extract32(v,x);\
+  dst.store(base, ux, (u64)_mm_extract_epi64(w,i%2), BIGSIZE0);
 #else
   u32 zz;
 #define STORE0(i,v,x,w) \
   zz = extract32(w,x);\
   if (i || likely(zz)) {\
     ux = extract32(v,x);\
-    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)\
-      *(u32 *)(base+dst.index[ux]) = 0;\
-    *(u32 *)(base+dst.index[ux]) = zz;\
-    dst.index[ux] += BIGSIZE0;\
+    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ)\
+      dst.store(base, ux, (u32)0, BIGSIZE0);\
+    dst.store(base, ux, zz, BIGSIZE0);\
     last[ux] = edge+i;\
   }
 #endif
@@ -441,21 +711,24 @@ public:
         vhi1 = _mm256_add_epi64(vhi1, vhiinc);
 
         u32 ux;
-#ifndef NEEDSYNC
+#ifdef COMPACT0
 #define STORE0(i,v,x,w) \
   ux = _mm256_extract_epi32(v,x);\
-  *(u64 *)(base+dst.index[ux]) = _mm256_extract_epi64(w,i%4);\
-  dst.index[ux] += BIGSIZE0;
+  storegap(dst, base, ux, edge+i - last[ux]);\
+  last[ux] = edge+i;
+#elif !defined NEEDSYNC
+#define STORE0(i,v,x,w) \
+  ux = _mm256_extract_epi32(v,x);\
+  dst.store(base, ux, (u64)_mm256_extract_epi64(w,i%4), BIGSIZE0);
 #else
   u32 zz;
 #define STORE0(i,v,x,w) \
   zz = _mm256_extract_epi32(w,x);\
   if (i || likely(zz)) {\
     ux = _mm256_extract_epi32(v,x);\
-    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)\
-      *(u32 *)(base+dst.index[ux]) = 0;\
-    *(u32 *)(base+dst.index[ux]) = zz;\
-    dst.index[ux] += BIGSIZE0;\
+    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ)\
+      dst.store(base, ux, (u32)0, BIGSIZE0);\
+    dst.store(base, ux, zz, BIGSIZE0);\
     last[ux] = edge+i;\
   }
 #endif
@@ -467,22 +740,29 @@ public:
       }
 #ifdef NEEDSYNC
       for (u32 ux=0; ux < NX; ux++) {
-        for (; last[ux]<endedge-NNONYZ; last[ux]+=NNONYZ) {
-          *(u32 *)(base+dst.index[ux]) = 0;
-          dst.index[ux] += BIGSIZE0;
-        }
+        for (; last[ux]<endedge-NNONYZ; last[ux]+=NNONYZ)
+          dst.store(base, ux, (u32)0, BIGSIZE0);
       }
 #endif
       sumsize += dst.storev(buckets, my);
     }
     rdtsc1 = __rdtsc();
+#ifdef COMPACT0
+    if (!id) print_log("genUnodes round %2d size %u bytes %u rdtsc: %lu\n", uorv, (endy-starty)*NYZ, sumsize, rdtsc1-rdtsc0);
+    tcounts[id] = (endy-starty)*NYZ;
+#else
     if (!id) print_log("genUnodes round %2d size %u rdtsc: %lu\n", uorv, sumsize/BIGSIZE0, rdtsc1-rdtsc0);
     tcounts[id] = sumsize/BIGSIZE0;
+#endif
+    tdone[(uorv & 1) * nthreads + id] = rdtsc1;
   }
 
   void genVnodes(const u32 id, const u32 uorv) {
     u64 rdtsc0, rdtsc1;
-#if NSIPHASH == 4
+#ifdef SIPHASH_BATCH
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+#elif NSIPHASH == 4
     const __m128i vxmask = _mm_set1_epi64x(XMASK);
     const __m128i vyzmask = _mm_set1_epi64x(YZMASK);
     const __m128i ff = _mm_set1_epi64x(0xffLL);
@@ -494,10 +774,17 @@ public:
     const __m256i vinit = _mm256_load_si256((__m256i *)&sip_keys);
     __m256i vpacket0, vpacket1, vhi0, vhi1;
     __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+#endif
+#ifdef COMPACT0
+    // U endpoints are recomputed a batch of edges at a time, so the
+    // siphash loads don't wait for the scattered stores of the batch before
+    const u32 GAPBATCH = 256;
+    alignas(64) u64 uindices[GAPBATCH] = {};
+    alignas(64) u64 uhashes[GAPBATCH];
 #endif
     const u32 NONDEGBITS = std::min(BIGSLOTBITS, 2 * YZBITS) - ZBITS;
     const u32 NONDEGMASK = (1 << NONDEGBITS) - 1;
-    indexer<ZBUCKETSIZE> dst;
+    bigindexer dst;
     indexer<TBUCKETSIZE> small;
   
     rdtsc0 = __rdtsc();
@@ -506,14 +793,47 @@ public:
     u8 const *small0 = (u8 *)tbuckets[id];
     const u32 startux = NX *  id    / nthreads;
     const u32   endux = NX * (id+1) / nthreads;
+#ifdef COMPACT0
+    const u32 ahead = aheadbytes(sizeof(u16));
+#else
+    const u32 ahead = aheadbytes(BIGSIZE0);
+#endif
+    readahead(startux, false, ahead);
     for (u32 ux = startux; ux < endux; ux++) { // matrix x == ux
       barrier();
+      if (ux+1 < endux)
+        readahead(ux+1, false, ahead);
       small.matrixu(0);
       for (u32 my = 0 ; my < NY; my++) {
         u32 edge = my << YZBITS;
         u8    *readbig = buckets[ux][my].bytes;
         u8 const *endreadbig = readbig + buckets[ux][my].size;
 // print_log("id %d x %d y %d size %u read %d\n", id, ux, my, buckets[ux][my].size, readbig-base);
+#ifdef COMPACT0
+        const u16 *readgap = (u16 *)readbig, *endreadgap = (u16 *)endreadbig;
+        edge--;
+        while (readgap < endreadgap) {
+          u32 n = 0;
+          for (; n < GAPBATCH && readgap < endreadgap; readgap++) {
+            const u32 gap = *readgap;
+            if (unlikely(!gap)) { edge += 0xffff; continue; }
+            edge += gap;
+            uindices[n++] = 2 * (u64)edge + (uorv ^ 1);
+          }
+          for (u32 i = 0; i < n; i += NSIPHASH)
+            siphash24xN(&sip_keys, uindices + i, uhashes + i);
+          for (u32 i = 0; i < n; i++) {
+            const u32 node = uhashes[i] & NODEMASK;
+            const u32 uy = (node >> ZBITS) & YMASK;
+// bit         39..13     12..0
+// write         edge     UZZZZ   within UX UY partition
+            *(u64 *)(small0+small.index[uy]) = (uindices[i] >> 1 << ZBITS) | (node & ZMASK);
+            small.index[uy] += SMALLSIZE;
+          }
+        }
+        if (unlikely(readbig < endreadbig && edge >> YZBITS != my))
+        { print_log("OOPS1: id %d ux %d y %d edge %x vs %x\n", id, ux, my, edge, ((my+1)<<YZBITS)-1); exit(0); }
+#else
         for (; readbig < endreadbig; readbig += BIGSIZE0) {
 // bit     39/31..21     20..13    12..0
 // read         edge     UYYYYY    UZZZZ   within UX partition
@@ -534,6 +854,7 @@ public:
         }
         if (unlikely(edge >> NONYZBITS != (((my+1) << YZBITS) - 1) >> NONYZBITS))
         { print_log("OOPS1: id %d ux %d y %d edge %x vs %x\n", id, ux, my, edge, ((my+1)<<YZBITS)-1); exit(0); }
+#endif
       }
       u8 *degs = tdegs[id];
       small.storeu(tbuckets+id, 0);
@@ -570,7 +891,18 @@ public:
         const u16 *readz = tzs[id];
         const u32 *readedge = edges0;
         int64_t uy34 = (int64_t)uy << YZZBITS;
-#if NSIPHASH == 4
+#ifdef SIPHASH_BATCH
+        for (; readedge <= edges-NSIPHASH; readedge += NSIPHASH, readz += NSIPHASH) {
+          for (u32 i = 0; i < NSIPHASH; i++)
+            indices[i] = 2 * (u64)readedge[i] + uorv;
+          siphash24xN(&sip_keys, indices, hashes);
+          for (u32 i = 0; i < NSIPHASH; i++) {
+            const u32 node = hashes[i] & NODEMASK;
+            const u32 vx = node >> YZBITS;
+            dst.store(base, vx, (u64)(uy34 | ((u64)readz[i] << YZBITS) | (node & YZMASK)), BIGSIZE);
+          }
+        }
+#elif NSIPHASH == 4
         const __m128i vuy34 = _mm_set1_epi64x(uy34);
         const __m128i vuorv = _mm_set1_epi64x(uorv);
         for (; readedge <= edges-NSIPHASH; readedge += NSIPHASH, readz += NSIPHASH) {
@@ -579,9 +911,9 @@ public:
           v6 = v2 = _mm_set1_epi64x(sip_keys.k2);
           v7 = v3 = _mm_set1_epi64x(sip_keys.k3);
 
-          vpacket0 = _mm_slli_epi64(_mm_cvtepu32_epi64(*(__m128i*) readedge     ), 1) | vuorv;
+          vpacket0 = _mm_slli_epi64(_mm_cvtepu32_epi64(_mm_loadl_epi64((__m128i*) readedge     )), 1) | vuorv;
           vhi0     = vuy34 | _mm_slli_epi64(_mm_cvtepu16_epi64(_mm_set_epi64x(0,*(u64*)readz)), YZBITS);
-          vpacket1 = _mm_slli_epi64(_mm_cvtepu32_epi64(*(__m128i*)(readedge + 2)), 1) | vuorv;
+          vpacket1 = _mm_slli_epi64(_mm_cvtepu32_epi64(_mm_loadl_epi64((__m128i*)(readedge + 2))), 1) | vuorv;
           vhi1     = vuy34 | _mm_slli_epi64(_mm_cvtepu16_epi64(_mm_set_epi64x(0,*(u64*)(readz + 2))), YZBITS);
 
           v3 = XOR(v3,vpacket0); v7 = XOR(v7,vpacket1);
@@ -601,8 +933,7 @@ public:
           u32 vx;
 #define STORE(i,v,x,w) \
   vx = extract32(v,x);\
-  *(u64 *)(base+dst.index[vx]) = _mm_extract_epi64(w,i%2);\
-  dst.index[vx] += BIGSIZE;
+  dst.store(base, vx, (u64)_mm_extract_epi64(w,i%2), BIGSIZE);
           STORE(0,v1,0,v0); STORE(1,v1,2,v0);
           STORE(2,v5,0,v4); STORE(3,v5,2,v4);
         }
@@ -637,22 +968,20 @@ public:
           u32 vx;
 #define STORE(i,v,x,w) \
   vx = _mm256_extract_epi32(v,x);\
-  *(u64 *)(base+dst.index[vx]) = _mm256_extract_epi64(w,i%4);\
-  dst.index[vx] += BIGSIZE;
+  dst.store(base, vx, (u64)_mm256_extract_epi64(w,i%4), BIGSIZE);
 // print_log("Id %d ux %d y %d edge %08x e' %010lx vx %d\n", id, ux, uy, readedge[i], _mm256_extract_epi64(w,i%4), vx);
 
           STORE(0,v1,0,v0); STORE(1,v1,2,v0); STORE(2,v1,4,v0); STORE(3,v1,6,v0);
           STORE(4,v5,0,v4); STORE(5,v5,2,v4); STORE(6,v5,4,v4); STORE(7,v5,6,v4);
         }
 #endif
-        for (; readedge < edges; readedge++, readz++) { // process up to 7 leftover edges if NSIPHASH==8
+        for (; readedge < edges; readedge++, readz++) { // process up to NSIPHASH-1 leftover edges
           const u32 node = sipnode(&sip_keys, *readedge, uorv);
           const u32 vx = node >> YZBITS; // & XMASK;
 // bit        39..34    33..21     20..13     12..0
 // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition
-          *(u64 *)(base+dst.index[vx]) = uy34 | ((u64)*readz << YZBITS) | (node & YZMASK);
+          dst.store(base, vx, (u64)(uy34 | ((u64)*readz << YZBITS) | (node & YZMASK)), BIGSIZE);
 // print_log("id %d ux %d y %d edge %08x e' %010lx vx %d\n", id, ux, uy, *readedge, uy34 | ((u64)(node & YZMASK) << ZBITS) | *readz, vx);
-          dst.index[vx] += BIGSIZE;
         }
       }
       sumsize += dst.storeu(buckets, ux);
@@ -660,6 +989,7 @@ public:
     rdtsc1 = __rdtsc();
     if (!id) print_log("genVnodes round %2d size %u rdtsc: %lu\n", uorv, sumsize/BIGSIZE, rdtsc1-rdtsc0);
     tcounts[id] = sumsize/BIGSIZE;
+    tdone[(uorv & 1) * nthreads + id] = rdtsc1;
   }
 
   template <u32 SRCSIZE, u32 DSTSIZE, bool TRIMONV>
@@ -673,7 +1003,7 @@ public:
     const u32 DSTPREFBITS = DSTSLOTBITS - YZZBITS;
     const u32 DSTPREFMASK = (1 << DSTPREFBITS) - 1;
     u64 rdtsc0, rdtsc1;
-    indexer<ZBUCKETSIZE> dst;
+    bigindexer dst;
     indexer<TBUCKETSIZE> small;
   
     rdtsc0 = __rdtsc();
@@ -682,8 +1012,12 @@ public:
     u8 const *small0 = (u8 *)tbuckets[id];
     const u32 startvx = NY *  id    / nthreads;
     const u32   endvx = NY * (id+1) / nthreads;
+    const u32 ahead = aheadbytes(SRCSIZE);
+    readahead(startvx, TRIMONV, ahead);
     for (u32 vx = startvx; vx < endvx; vx++) {
       barrier();
+      if (vx+1 < endvx)
+        readahead(vx+1, TRIMONV, ahead);
       small.matrixu(0);
       for (u32 ux = 0 ; ux < NX; ux++) {
         u32 uxyz = ux << YZBITS;
@@ -725,8 +1059,7 @@ public:
 // print_log("id %d vx %d vy %d e %010lx suffUX %02x UX %x mask %x\n", id, vx, vy, e, (u32)(e >> YZZBITS), ux, SRCPREFMASK);
 // bit    41/39..34    33..21     20..13     12..0
 // write     VYYYYY    VZZZZZ     UYYYYY     UZZZZ   within UX partition
-          *(u64 *)(base+dst.index[ux]) = vy34 | ((e & ZMASK) << YZBITS) | ((e >> ZBITS) & YZMASK);
-          dst.index[ux] += degs[(e & ZMASK) ^ 1];
+          dst.store(base, ux, vy34 | ((e & ZMASK) << YZBITS) | ((e >> ZBITS) & YZMASK), degs[(e & ZMASK) ^ 1]);
         }
         if (unlikely(ux >> DSTPREFBITS != XMASK >> DSTPREFBITS))
         { print_log("OOPS4: id %d vx %x ux %x vs %x\n", id, vx, ux, XMASK); }
@@ -737,6 +1070,7 @@ public:
     if (showall || (!id && !(round & (round+1))))
       print_log("trimedges id %d round %2d size %u rdtsc: %lu\n", id, round, sumsize/DSTSIZE, rdtsc1-rdtsc0);
     tcounts[id] = sumsize/DSTSIZE;
+    tdone[(round & 1) * nthreads + id] = rdtsc1;
   }
 
   template <u32 SRCSIZE, u32 DSTSIZE, bool TRIMONV>
@@ -756,9 +1090,7 @@ public:
     offset_t sumsize = 0;
     u8 const *base = (u8 *)buckets;
     u8 const *small0 = (u8 *)tbuckets[id];
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstrow(id, round); vx < NY; vx = nextrow(id, round, vx)) {
       small.matrixu(0);
       for (u32 ux = 0 ; ux < NX; ux++) {
         u32 uyz = 0;
@@ -845,6 +1177,7 @@ public:
     if (maxnnid >= NYZ1) print_log("maxnnid %d >= NYZ1 %d\n", maxnnid, NYZ1);
     assert(maxnnid < NYZ1);
     tcounts[id] = sumsize/DSTSIZE;
+    tdone[(round & 1) * nthreads + id] = rdtsc1;
   }
 
   template <bool TRIMONV>
@@ -853,12 +1186,16 @@ public:
     indexer<ZBUCKETSIZE> dst;
   
     rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    offset_t sumsize = 0, maxsize = 0;
     u8 *degs = tdegs[id];
     u8 const *base = (u8 *)buckets;
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+#ifdef __AVX2__
+    const __m256i vyz1mask = _mm256_set1_epi32(YZ1MASK);
+    const __m256i vone = _mm256_set1_epi32(1);
+    const __m256i vbyte = _mm256_set1_epi32(0xff);
+    const __m256i vzero = _mm256_setzero_si256();
+#endif
+    for (u32 vx = firstrow(id, round); vx < NY; vx = nextrow(id, round, vx)) {
       TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
       memset(degs, 0, NYZ1);
       for (u32 ux = 0 ; ux < NX; ux++) {
@@ -871,6 +1208,19 @@ public:
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
+#ifdef __AVX2__
+        // 8 edges at a time: gather the partner degrees, and left-pack the
+        // survivors. the 32 byte store never passes the unread edges
+        for (; readbig + 8 <= endreadbig; readbig += 8) {
+          const __m256i e = _mm256_loadu_si256((__m256i *)readbig);
+          const __m256i vyz = _mm256_and_si256(e, vyz1mask);
+          const __m256i deg = _mm256_and_si256(_mm256_i32gather_epi32((const int *)degs, _mm256_xor_si256(vyz, vone), 1), vbyte);
+          const u32 keep = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(deg, vzero)));
+          const __m256i w = _mm256_or_si256(_mm256_slli_epi32(vyz, YZ1BITS), _mm256_srli_epi32(e, YZ1BITS));
+          _mm256_storeu_si256((__m256i *)(base+dst.index[ux]), leftpack(w, keep));
+          dst.index[ux] += __builtin_popcount(keep) * sizeof(u32);
+        }
+#endif
         for (; readbig < endreadbig; readbig++) {
 // bit       31...16     15...0
 // read      UYYZZZ'     VYYZZ'   within VX partition
@@ -883,12 +1233,16 @@ public:
           dst.index[ux] += degs[vyz ^ 1];
         }
       }
-      sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+      const offset_t size = TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+      sumsize += size;
+      maxsize = std::max(maxsize, size);
     }
     rdtsc1 = __rdtsc();
     if (showall || (!id && !(round & (round+1))))
       print_log("trimedges1 id %d round %2d size %u rdtsc: %lu\n", id, round, sumsize/sizeof(u32), rdtsc1-rdtsc0);
     tcounts[id] = sumsize/sizeof(u32);
+    tdone[(round & 1) * nthreads + id] = rdtsc1;
+    tmaxsizes[id] = maxsize/sizeof(u32);
   }
 
   template <bool TRIMONV>
@@ -901,9 +1255,7 @@ public:
     offset_t sumsize = 0;
     u8 *degs = tdegs[id];
     u8 const *base = (u8 *)buckets;
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstrow(id, round); vx < NY; vx = nextrow(id, round, vx)) {
       TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
       memset(degs, 0, NYZ1);
       for (u32 ux = 0 ; ux < NX; ux++) {
@@ -953,22 +1305,26 @@ public:
     if (maxnnid >= NYZ2) print_log("maxnnid %d >= NYZ2 %d\n", maxnnid, NYZ2);
     assert(maxnnid < NYZ2);
     tcounts[id] = sumsize/sizeof(u32);
+    tdone[(round & 1) * nthreads + id] = rdtsc1;
   }
 
-  void trim() {
-    void *etworker(void *vp);
+  void begintrim(thread_pool &pool) {
+    void etworker(void *vp, const unsigned id);
+    assert(pool.nthreads == nthreads);
     barry.clear();
-    for (u32 t = 0; t < nthreads; t++) {
-      threads[t].id = t;
-      threads[t].et = this;
-      int err = pthread_create(&threads[t].thread, NULL, etworker, (void *)&threads[t]);
-      assert(err == 0);
+    rowcounters[0].next = rowcounters[1].next = 0;
+    if (filebuckets) {
+      buckets = filebuckets;
+      clearfile();
+      if (membuckets)
+        madvise(membuckets, hugepage_round(sizeof(matrix<ZBUCKETSIZE>), bucketpages), MADV_DONTNEED);
     }
+    pool.start(etworker, (void *)this);
+  }
+  void trim(thread_pool &pool) {
+    begintrim(pool);
     // sleep(7); abort();
-    for (u32 t = 0; t < nthreads; t++) {
-      int err = pthread_join(threads[t].thread, NULL);
-      assert(err == 0);
-    }
+    pool.wait();
   }
   void abort() {
     barry.abort();
@@ -985,12 +1341,72 @@ public:
 #define BIGGERSIZE BIGSIZE
 #define EXPANDROUND COMPRESSROUND
 #endif
+  // whether adaptive trimming can skip to trimrename1 after the pair of
+  // rounds ending in round, given prevcount edges before the pair, which
+  // gets updated. trimrename1 can only rename nodes of rows and columns
+  // smaller than NYZ2, which only trimedges1 rounds keep track of.
+  // called by all threads after a barrier, with identical outcome
+  bool stoptrim(const u32 round, offset_t &prevcount) const {
+    const paircount *pc = paircounts + ((round >> 1) & 1) * nthreads;
+    offset_t cnt = 0;
+    u32 maxsize = 0;
+    for (u32 t = 0; t < nthreads; t++) {
+      cnt += pc[t].count;
+      maxsize = std::max(maxsize, pc[t].maxsize);
+    }
+    const bool slow = (u64)(prevcount - cnt) * 1024 < (u64)2 * trimstop * prevcount;
+    prevcount = cnt;
+    return maxsize < NYZ2 && (slow || cnt <= tailedges);
+  }
+  // whether buckets in a file now fit in bucketmem bytes of memory, given
+  // that each may use a few partial pages. renaming rounds leave renames
+  // at the bucket ends, so buckets can only move before those
+  bool fitmemory(const u32 round) const {
+    return membuckets && buckets == filebuckets && round < COMPRESSROUND &&
+      (u64)count() * BIGGERSIZE + (u64)NX * NY * 4 * 4096 <= bucketmem;
+  }
+  // move buckets from the file to memory, each thread its own rows
+  void tomemory(const u32 id, const u32 round) {
+    const u32 startux = NX *  id    / nthreads;
+    const u32   endux = NX * (id+1) / nthreads;
+    const u32 ahead = aheadbytes(BIGGERSIZE);
+    readahead(startux, false, ahead);
+    for (u32 ux = startux; ux < endux; ux++) {
+      if (ux+1 < endux)
+        readahead(ux+1, false, ahead);
+      for (u32 vx = 0; vx < NY; vx++) {
+        const zbucket<ZBUCKETSIZE> &from = filebuckets[ux][vx];
+        zbucket<ZBUCKETSIZE> &to = membuckets[ux][vx];
+        memcpy(to.bytes, from.bytes, to.size = from.size);
+      }
+    }
+    barrier();
+    if (!id) {
+      buckets = membuckets;
+      clearfile();
+      print_log("buckets moved to memory after round %d with %u edges\n", round-1, count());
+    }
+    barrier();
+  }
   void trimmer(u32 id) {
+    if (numa)
+      pin(id); // in case pool recreated thread
     genUnodes(id, 0);
     barrier();
+    showtail(id, 0);
     genVnodes(id, 1);
-    for (u32 round = 2; round < ntrims-2; round += 2) {
+    const bool adaptive = trimstop || tailedges;
+    offset_t prevcount = NEDGES;
+    u32 round;
+    for (round = 2; round < ntrims-2; round += 2) {
       barrier();
+      showtail(id, round-1);
+      if (adaptive && round > 2 && stoptrim(round-1, prevcount)) {
+        if (!id) print_log("adaptive trimming stops after round %d with %u edges\n", round-1, prevcount);
+        break;
+      }
+      if (fitmemory(round))
+        tomemory(id, round);
       if (round < COMPRESSROUND) {
         if (round < EXPANDROUND)
           trimedges<BIGSIZE, BIGSIZE, true>(id, round);
@@ -1000,7 +1416,9 @@ public:
       } else if (round==COMPRESSROUND) {
         trimrename<BIGGERSIZE, BIGGERSIZE, true>(id, round);
       } else trimedges1<true>(id, round);
+      const u32 maxsize = round > COMPRESSROUND ? tmaxsizes[id] : NYZ2;
       barrier();
+      showtail(id, round);
       if (round < COMPRESSROUND) {
         if (round+1 < EXPANDROUND)
           trimedges<BIGSIZE, BIGSIZE, false>(id, round+1);
@@ -1010,19 +1428,26 @@ public:
       } else if (round==COMPRESSROUND) {
         trimrename<BIGGERSIZE, sizeof(u32), false>(id, round+1);
       } else trimedges1<false>(id, round+1);
+      paircount &pc = paircounts[(((round+1) >> 1) & 1) * nthreads + id];
+      pc.count = tcounts[id];
+      pc.maxsize = round > COMPRESSROUND ? std::max(maxsize, tmaxsizes[id]) : NYZ2;
     }
     barrier();
-    trimrename1<true >(id, ntrims-2);
+    if (round >= ntrims-2) // else shown before adaptive stop
+      showtail(id, round-1);
+    trimrename1<true >(id, round);
     barrier();
-    trimrename1<false>(id, ntrims-1);
+    showtail(id, round);
+    trimrename1<false>(id, round+1);
   }
 };
 
-void *etworker(void *vp) {
-  thread_ctx *tp = (thread_ctx *)vp;
-  tp->et->trimmer(tp->id);
-  pthread_exit(NULL);
-  return 0;
+void etworker(void *vp, const unsigned id) {
+  ((edgetrimmer *)vp)->trimmer(id);
+}
+
+void numaworker(void *vp, const unsigned id) {
+  ((edgetrimmer *)vp)->numatouch(id);
 }
 
 #define NODEBITS (EDGEBITS + 1)
@@ -1038,21 +1463,25 @@ int nonce_cmp(const void *a, const void *b) {
 
 typedef word_t proof[PROOFSIZE];
 
-// break circular reference with forward declaration
-class solver_ctx;
-
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  solver_ctx *solver;
-} match_ctx;
-
 class solver_ctx {
 public:
   edgetrimmer trimmer;
   graph<word_t> cg;
+  std::vector<word_t> cgedges; // u,v pairs for cg.add_edges with multiple threads
+  thread_pool pool; // parked between nonces; runs both trimming and matchUnodes
   bool showcycle;
   bool mutatenonce;
+  bool pipeline;
+  // in pipelined mode, the edges surviving trimming of the previous nonce
+  // are copied out of trimmer.buckets, together with the keys and renamed-back
+  // full node ids that solution recovery needs, so that the trimmer can
+  // proceed with the next nonce while we look for cycles.
+  graph<word_t> *tailcg; // can't share tbuckets memory with the trimmer
+  siphash_keys tailkeys;
+  siphash_keys solkeys; // keys for the tail whose solutions are in sols
+  bool tailvalid;
+  std::vector<u32> tailedges; // pairs of compressed u,v nodes in findcycles order
+  std::vector<word_t> tailnodes; // corresponding pairs of full u,v nodes
   proof cycleus;
   proof cyclevs;
   std::bitset<NXY> uxymap;
@@ -1069,12 +1498,20 @@ public:
   }
 #endif
 
-  solver_ctx(const u32 nthreads, const u32 n_trims, bool allrounds, bool show_cycle, bool mutate_nonce)
-    : trimmer(nthreads, n_trims, allrounds), 
-      cg(MAXEDGES, MAXEDGES, MAX_SOLS, 0, (char *)trimmer.tbuckets) {
+  solver_ctx(const u32 nthreads, const u32 n_trims, const u32 trim_stop, const u32 tail_edges, bool allrounds, bool show_cycle, bool mutate_nonce, bool pipe_line, hugepage_mode huge_pages, bool numa, const char *bucket_dir = 0, const u32 bucket_mb = 0)
+    : trimmer(nthreads, n_trims, trim_stop, tail_edges, allrounds, huge_pages, numa, bucket_dir, bucket_mb), 
+      cg(MAXEDGES, MAXEDGES, MAX_SOLS, 0, (char *)trimmer.tbuckets), pool(nthreads) {
     assert(cg.bytes() <= sizeof(yzbucket<TBUCKETSIZE>[nthreads])); // check that graph cg can fit in tbucket's memory
     showcycle = show_cycle;
     mutatenonce = mutate_nonce;
+#ifdef SAVEEDGES
+    pipe_line = false; // recovery needs edges saved in trimmer.buckets
+#endif
+    pipeline = pipe_line;
+    tailcg = pipeline ? new graph<word_t>(MAXEDGES, MAXEDGES, MAX_SOLS, 0) : 0;
+    tailvalid = false;
+    if (trimmer.numa)
+      pool.run(numaworker, (void *)&trimmer);
   }
   void setheadernonce(char* const headernonce, const u32 len, const u32 nonce) {
     if (mutatenonce) {
@@ -1084,29 +1521,34 @@ public:
     sols.clear();
   }
   ~solver_ctx() {
+    delete tailcg;
   }
-  u64 sharedbytes() const {
+  static u64 sharedbytes() {
     return sizeof(matrix<ZBUCKETSIZE>);
   }
-  u32 threadbytes() const {
-    return sizeof(thread_ctx) + sizeof(yzbucket<TBUCKETSIZE>) + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32);
+  static u32 threadbytes() {
+    return sizeof(yzbucket<TBUCKETSIZE>) + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32);
   }
-  void recordedge(const u32 i, const u32 u1, const u32 v2) {
+  // undo the renaming of the trimrename(1) rounds
+  void fullnodes(const u32 u1, const u32 v1, word_t &u, word_t &v) const {
     const u32 ux = u1 >> YZ2BITS;
     u32 uyz = trimmer.buckets[ux][(u1 >> Z2BITS) & YMASK].renameu1[(u1 & Z2MASK) >> 1] | (u1 & 1);
-    const u32 v1 = v2 - MAXEDGES;
     const u32 vx = v1 >> YZ2BITS;
     u32 vyz = trimmer.buckets[(v1 >> Z2BITS) & YMASK][vx].renamev1[(v1 & Z2MASK) >> 1] | (v1 & 1);
 #if COMPRESSROUND > 0
     uyz = trimmer.buckets[ux][uyz >> Z1BITS].renameu[(uyz & Z1MASK) >> 1] | (u1 & 1);
     vyz = trimmer.buckets[vyz >> Z1BITS][vx].renamev[(vyz & Z1MASK) >> 1] | (v1 & 1);
 #endif
-    const u32 u = cycleus[i] = (ux << YZBITS) | uyz;
-    cyclevs[i] = (vx << YZBITS) | vyz;
+    u = (ux << YZBITS) | uyz;
+    v = (vx << YZBITS) | vyz;
+  }
+  void recordedge(const u32 i, const u32 u1, const u32 v2) {
+    fullnodes(u1, v2 - MAXEDGES, cycleus[i], cyclevs[i]);
+    const u32 u = cycleus[i];
     // print_log(" (%x,%x)", u, cyclevs[i]);
 #ifdef SAVEEDGES
     u32 v = cyclevs[i];
-    u32 *readedges = trimmer.buckets[ux][uyz >> ZBITS].edges, *endreadedges = readedges + NTRIMMEDZ;
+    u32 *readedges = trimmer.buckets[u >> YZBITS][(u & YZMASK) >> ZBITS].edges, *endreadedges = readedges + NTRIMMEDZ;
     for (; readedges < endreadedges; readedges++) {
       u32 edge = *readedges;
       if (sipnode(&trimmer.sip_keys, edge, 1) == v && sipnode(&trimmer.sip_keys, edge, 0) == u) {
@@ -1127,20 +1569,10 @@ public:
     // print_log("\n");
     if (showcycle) {
 #ifndef SAVEEDGES
-      void *matchworker(void *vp);
+      void matchworker(void *vp, const unsigned id);
 
       sols.resize(sols.size() + PROOFSIZE);
-      match_ctx *threads = new match_ctx[trimmer.nthreads];
-      for (u32 t = 0; t < trimmer.nthreads; t++) {
-        threads[t].id = t;
-        threads[t].solver = this;
-        int err = pthread_create(&threads[t].thread, NULL, matchworker, (void *)&threads[t]);
-        assert(err == 0);
-      }
-      for (u32 t = 0; t < trimmer.nthreads; t++) {
-        int err = pthread_join(threads[t].thread, NULL);
-        assert(err == 0);
-      }
+      pool.run(matchworker, (void *)this);
 #endif
       qsort(&sols[sols.size()-PROOFSIZE], PROOFSIZE, sizeof(u32), nonce_cmp);
     }
@@ -1151,6 +1583,7 @@ public:
   
     rdtsc0 = __rdtsc();
     cg.reset();
+    cgedges.clear();
     for (u32 vx = 0; vx < NX; vx++) {
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = trimmer.buckets[ux][vx];
@@ -1163,10 +1596,17 @@ public:
           const u32 u = (ux << YZ2BITS) | (e >> YZ2BITS);
           const u32 v = (vx << YZ2BITS) | (e & YZ2MASK);
           // print_log("add_edge(%x, %x)\n", u, v);
-          cg.add_edge(u, v);
+          if (pool.nthreads == 1)
+            cg.add_edge(u, v);
+          else {
+            cgedges.push_back(u);
+            cgedges.push_back(v);
+          }
         }
       }
     }
+    if (pool.nthreads > 1)
+      cg.add_edges(cgedges.data(), cgedges.size() / 2, pool);
     for (u32 s=0; s < cg.nsols; s++) {
       solution(cg.sols[s]);
     }
@@ -1179,22 +1619,95 @@ public:
   }
 
   int solve() {
-    trimmer.trim();
+    trimmer.trim(pool);
     if (!trimmer.aborted())
       findcycles();
     return sols.size() / PROOFSIZE;
   }
 
-  void *matchUnodes(match_ctx *mc) {
+  // copy surviving edges of the just trimmed nonce for use by findtailcycles
+  void savetail() {
+    tailkeys = trimmer.sip_keys;
+    tailedges.clear();
+    tailnodes.clear();
+    for (u32 vx = 0; vx < NX; vx++) {
+      for (u32 ux = 0 ; ux < NX; ux++) {
+        zbucket<ZBUCKETSIZE> &zb = trimmer.buckets[ux][vx];
+        u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
+        for (; readbig < endreadbig; readbig++) {
+          const u32 e = *readbig;
+          const u32 u = (ux << YZ2BITS) | (e >> YZ2BITS);
+          const u32 v = (vx << YZ2BITS) | (e & YZ2MASK);
+          word_t fu, fv;
+          fullnodes(u, v, fu, fv);
+          tailedges.push_back(u);
+          tailedges.push_back(v);
+          tailnodes.push_back(fu);
+          tailnodes.push_back(fv);
+        }
+      }
+    }
+    tailvalid = true;
+  }
+
+  // single threaded findcycles and solution recovery on saved tail
+  void findtailcycles() {
     u64 rdtsc0, rdtsc1;
   
     rdtsc0 = __rdtsc();
-    const u32 starty = NY *  mc->id    / trimmer.nthreads;
-    const u32   endy = NY * (mc->id+1) / trimmer.nthreads;
+    solkeys = tailkeys;
+    tailcg->reset();
+    for (u32 i = 0; i < tailedges.size(); i += 2)
+      tailcg->add_edge(tailedges[i], tailedges[i+1]);
+    for (u32 s=0; s < tailcg->nsols; s++) {
+      for (u32 i = 0; i < PROOFSIZE; i++) {
+        const word_t e = tailcg->sols[s][i];
+        cycleus[i] = tailnodes[2*e];
+        cyclevs[i] = tailnodes[2*e+1];
+        uxymap[cycleus[i] >> ZBITS] = 1;
+      }
+      if (showcycle) {
+        sols.resize(sols.size() + PROOFSIZE);
+        matchUnodes(tailkeys, 0, 1);
+        qsort(&sols[sols.size()-PROOFSIZE], PROOFSIZE, sizeof(u32), nonce_cmp);
+      }
+    }
+    rdtsc1 = __rdtsc();
+    print_log("findcycles rdtsc: %lu\n", rdtsc1-rdtsc0);
+  }
+
+  // trim the nonce given to setheadernonce (unless lastnonce) on the thread pool,
+  // while the calling thread finds cycles on the previously trimmed nonce.
+  // returns the number of solutions for the latter, whose keys are in tailkeys.
+  int solve_pipelined(const bool lastnonce) {
+    const bool findtail = tailvalid;
+    tailvalid = false;
+    sols.clear();
+    if (!lastnonce)
+      trimmer.begintrim(pool);
+    if (findtail)
+      findtailcycles();
+    if (!lastnonce) {
+      pool.wait();
+      if (!trimmer.aborted())
+        savetail();
+    }
+    return sols.size() / PROOFSIZE;
+  }
+
+  void matchUnodes(const siphash_keys &keys, const u32 id, const u32 nthreads) {
+    u64 rdtsc0, rdtsc1;
+  
+    rdtsc0 = __rdtsc();
+    const u32 starty = NY *  id    / nthreads;
+    const u32   endy = NY * (id+1) / nthreads;
     u32 edge = starty << YZBITS, endedge = edge + NYZ;
-  #if NSIPHASH == 4
+  #ifdef SIPHASH_BATCH
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+  #elif NSIPHASH == 4
     const __m128i vnodemask = _mm_set1_epi64x(NODEMASK);
-    siphash_keys &sip_keys = trimmer.sip_keys;
+    const siphash_keys &sip_keys = keys;
     __m128i v0, v1, v2, v3, v4, v5, v6, v7;
     const u32 e2 = 2 * edge;
     __m128i vpacket0 = _mm_set_epi64x(e2+2, e2+0);
@@ -1202,7 +1715,7 @@ public:
     const __m128i vpacketinc = _mm_set1_epi64x(8);
   #elif NSIPHASH == 8
     const __m256i vnodemask = _mm256_set1_epi64x(NODEMASK);
-    const __m256i vinit = _mm256_load_si256((__m256i *)&trimmer.sip_keys);
+    const __m256i vinit = _mm256_loadu_si256((__m256i *)&keys);
     __m256i v0, v1, v2, v3, v4, v5, v6, v7;
     const u32 e2 = 2 * edge;
     __m256i vpacket0 = _mm256_set_epi64x(e2+6, e2+4, e2+2, e2+0);
@@ -1213,12 +1726,17 @@ public:
       for (; edge < endedge; edge += NSIPHASH) {
   // bit        28..21     20..13    12..0
   // node       XXXXXX     YYYYYY    ZZZZZ
-  #if NSIPHASH == 1
-        const u32 nodeu = sipnode(&trimmer.sip_keys, edge, 0);
-        if (uxymap[nodeu >> ZBITS]) {
-          for (u32 j = 0; j < PROOFSIZE; j++) {
-            if (cycleus[j] == nodeu && cyclevs[j] == sipnode(&trimmer.sip_keys, edge, 1)) {
-              sols[sols.size()-PROOFSIZE + j] = edge;
+  #ifdef SIPHASH_BATCH
+        for (u32 i = 0; i < NSIPHASH; i++)
+          indices[i] = 2 * (u64)(edge + i);
+        siphash24xN(&keys, indices, hashes);
+        for (u32 i = 0; i < NSIPHASH; i++) {
+          const u32 nodeu = hashes[i] & NODEMASK;
+          if (uxymap[nodeu >> ZBITS]) {
+            for (u32 j = 0; j < PROOFSIZE; j++) {
+              if (cycleus[j] == nodeu && cyclevs[j] == sipnode(&keys, edge + i, 1)) {
+                sols[sols.size()-PROOFSIZE + j] = edge + i;
+              }
             }
           }
         }
@@ -1252,7 +1770,7 @@ public:
   if (uxymap[uxy]) {\
     u32 u = extract32(w,x);\
     for (u32 j = 0; j < PROOFSIZE; j++) {\
-      if (cycleus[j] == u && cyclevs[j] == sipnode(&trimmer.sip_keys, edge+i, 1)) {\
+      if (cycleus[j] == u && cyclevs[j] == sipnode(&keys, edge+i, 1)) {\
         sols[sols.size()-PROOFSIZE + j] = edge + i;\
       }\
     }\
@@ -1287,7 +1805,7 @@ public:
   if (uxymap[uxy]) {\
     u32 u = _mm256_extract_epi32(w,x);\
     for (u32 j = 0; j < PROOFSIZE; j++) {\
-      if (cycleus[j] == u && cyclevs[j] == sipnode(&trimmer.sip_keys, edge+i, 1)) {\
+      if (cycleus[j] == u && cyclevs[j] == sipnode(&keys, edge+i, 1)) {\
         sols[sols.size()-PROOFSIZE + j] = edge + i;\
       }\
     }\
@@ -1300,15 +1818,11 @@ public:
       }
     }
     rdtsc1 = __rdtsc();
-    if (trimmer.showall || !mc->id) print_log("matchUnodes id %d rdtsc: %lu\n", mc->id, rdtsc1-rdtsc0);
-    pthread_exit(NULL);
-    return 0;
+    if (trimmer.showall || !id) print_log("matchUnodes id %d rdtsc: %lu\n", id, rdtsc1-rdtsc0);
   }
 };
 
-void *matchworker(void *vp) {
-  match_ctx *tp = (match_ctx *)vp;
-  tp->solver->matchUnodes(tp);
-  pthread_exit(NULL);
-  return 0;
+void matchworker(void *vp, const unsigned id) {
+  solver_ctx *ctx = (solver_ctx *)vp;
+  ctx->matchUnodes(ctx->trimmer.sip_keys, id, ctx->trimmer.nthreads);
 }
@@ -0,0 +1,85 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// the mean solver for one configuration of EDGEBITS, XBITS and NSIPHASH,
+// compiled with -DENGINE=name into namespace name so that several of them
+// can be linked into a single library. everything outside this source tree
+// must be included before the namespace opens, and the caller interface
+// from solverapi.h is kept outside so that all engines share it.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <x86intrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <ctime>
+#include <new>
+#include <vector>
+#include "../crypto/blake2.h"
+#include "../crypto/portable_endian.h"
+#include "solverapi.h"
+#include "engine.h"
+
+#ifndef ENGINE
+#error define ENGINE as the name of this configuration
+#endif
+
+#define SOLVER_ENGINE
+
+namespace ENGINE {
+#include "mean.cpp"
+
+void *create(SolverParams *params) {
+  return create_solver_ctx(params);
+}
+int run(void *ctx, char *header, int header_length, u32 nonce, u32 range, SolverSolutions *solutions, SolverStats *stats) {
+  return run_solver((SolverCtx *)ctx, header, header_length, nonce, range, solutions, stats);
+}
+void destroy(void *ctx) {
+  destroy_solver_ctx((SolverCtx *)ctx);
+}
+void stop(void *ctx) {
+  stop_solver((SolverCtx *)ctx);
+}
+u64 sharedbytes(void *ctx) {
+  return ((SolverCtx *)ctx)->sharedbytes();
+}
+u64 threadbytes(void *ctx) {
+  return ((SolverCtx *)ctx)->threadbytes();
+}
+}
+
+#if NSIPHASH == 8
+#define CPUFEATURE "avx2"
+#elif NSIPHASH == 4
+#define CPUFEATURE "sse4.1"
+#else
+#define CPUFEATURE 0
+#endif
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+#define CAT_(x,y) x##y
+#define CAT(x,y) CAT_(x,y)
+
+extern const solver_engine CAT(ENGINE,_engine) = {
+  STR(ENGINE), EDGEBITS, XBITS, NSIPHASH, CPUFEATURE,
+  ENGINE::create, ENGINE::run, ENGINE::destroy, ENGINE::stop, ENGINE::sharedbytes, ENGINE::threadbytes
+};
@@ -0,0 +1,235 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// the cpu mean solver library: the usual solver api on top of engines
+// for all supported configurations, one of which is picked when creating
+// the solver context. all trimming code remains specialized at compile time.
+
+#include "engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+// arbitrary length of header hashed into siphash key
+#define HEADERLEN 80
+
+// edge bits to solve for when the caller doesn't say
+#ifndef DEFAULT_EDGEBITS
+#define DEFAULT_EDGEBITS 31
+#endif
+
+// configurations as built by the Makefile's meanlib target
+#define MEAN_ENGINES(E) \
+  E(mean19x1) E(mean19x8) \
+  E(mean29x1) E(mean29x4) E(mean29x8) \
+  E(mean30x1) E(mean30x4) E(mean30x8) \
+  E(mean31x1) E(mean31x4) E(mean31x8)
+
+#define DECLARE(name) extern const solver_engine name##_engine;
+MEAN_ENGINES(DECLARE)
+#define LIST(name) &name##_engine,
+const solver_engine *engines[] = { MEAN_ENGINES(LIST) };
+const u32 NENGINES = sizeof(engines) / sizeof(engines[0]);
+
+struct SolverCtx {
+  const solver_engine *engine;
+  void *ctx;
+};
+
+// the engine for the requested edgebits, and xbits and nsiphash if nonzero,
+// with the most siphash lanes the cpu supports, or 0 if there is none
+const solver_engine *select_engine(const SolverParams *params) {
+  const u32 edgebits = params->edgebits ? params->edgebits : DEFAULT_EDGEBITS;
+  const solver_engine *best = 0;
+  __builtin_cpu_init();
+  for (u32 i = 0; i < NENGINES; i++) {
+    const solver_engine *e = engines[i];
+    if (e->edgebits != edgebits
+     || (params->xbits && e->xbits != params->xbits)
+     || (params->nsiphash && e->nsiphash != params->nsiphash))
+      continue;
+    // __builtin_cpu_supports only takes string literals
+    if (e->cpufeature && !strcmp(e->cpufeature, "avx2") && !__builtin_cpu_supports("avx2"))
+      continue;
+    if (e->cpufeature && !strcmp(e->cpufeature, "sse4.1") && !__builtin_cpu_supports("sse4.1"))
+      continue;
+    if (!best || e->nsiphash > best->nsiphash)
+      best = e;
+  }
+  return best;
+}
+
+CALL_CONVENTION int run_solver(SolverCtx* ctx,
+                               char* header,
+                               int header_length,
+                               u32 nonce,
+                               u32 range,
+                               SolverSolutions *solutions,
+                               SolverStats *stats
+                               )
+{
+  return ctx->engine->run_solver(ctx->ctx, header, header_length, nonce, range, solutions, stats);
+}
+
+CALL_CONVENTION SolverCtx* create_solver_ctx(SolverParams* params) {
+  const solver_engine *engine = select_engine(params);
+  if (!engine)
+    return 0;
+  SolverCtx* ctx = new SolverCtx;
+  ctx->engine = engine;
+  ctx->ctx = engine->create_solver_ctx(params);
+  return ctx;
+}
+
+CALL_CONVENTION void destroy_solver_ctx(SolverCtx* ctx) {
+  ctx->engine->destroy_solver_ctx(ctx->ctx);
+  delete ctx;
+}
+
+CALL_CONVENTION void stop_solver(SolverCtx* ctx) {
+  ctx->engine->stop_solver(ctx->ctx);
+}
+
+CALL_CONVENTION void fill_default_params(SolverParams* params) {
+	// not required in this solver
+}
+
+#ifndef SOLVER_LIBRARY
+int main(int argc, char **argv) {
+  u32 nthreads = 0;
+  u32 ntrims = 0;
+  u32 nonce = 0;
+  u32 range = 1;
+  bool showcycle = 0;
+  char header[HEADERLEN];
+  u32 len;
+  bool allrounds = false;
+  bool pipeline = false;
+  u32 hugepages = 0;
+  bool numa = false;
+  u32 edgebits = 0;
+  u32 xbits = 0;
+  u32 nsiphash = 0;
+  u32 trimstop = 0;
+  u32 tailedges = 0;
+  u32 nonces = 1;
+  u32 budgetmb = 0;
+  int c;
+
+  memset(header, 0, sizeof(header));
+  while ((c = getopt (argc, argv, "aA:b:B:e:h:H:k:m:n:Npr:st:w:x:X:")) != -1) {
+    switch (c) {
+      case 'a':
+        allrounds = true;
+        break;
+      case 'A':
+        trimstop = atoi(optarg);
+        break;
+      case 'b':
+        tailedges = atoi(optarg);
+        break;
+      case 'B':
+        budgetmb = atoi(optarg);
+        break;
+      case 'e':
+        edgebits = atoi(optarg);
+        break;
+      case 'h':
+        len = strlen(optarg);
+        assert(len <= sizeof(header));
+        memcpy(header, optarg, len);
+        break;
+      case 'H':
+        hugepages = atoi(optarg);
+        assert(hugepages <= 3);
+        break;
+      case 'x':
+        len = strlen(optarg)/2;
+        assert(len == sizeof(header));
+        for (u32 i=0; i<len; i++)
+          sscanf(optarg+2*i, "%2hhx", header+i);
+        break;
+      case 'X':
+        xbits = atoi(optarg);
+        break;
+      case 'n':
+        nonce = atoi(optarg);
+        break;
+      case 'N':
+        numa = true;
+        break;
+      case 'p':
+        pipeline = true;
+        break;
+      case 'r':
+        range = atoi(optarg);
+        break;
+      case 'k':
+        nonces = atoi(optarg);
+        break;
+      case 'm':
+        ntrims = atoi(optarg) & -2; // make even as required by solve()
+        break;
+      case 's':
+        showcycle = true;
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+      case 'w':
+        nsiphash = atoi(optarg);
+        break;
+    }
+  }
+
+  SolverParams params;
+  params.nthreads = nthreads;
+  params.ntrims = ntrims;
+  params.showcycle = showcycle;
+  params.allrounds = allrounds;
+  params.pipeline = pipeline;
+  params.hugepages = hugepages;
+  params.numa = numa;
+  params.edgebits = edgebits;
+  params.xbits = xbits;
+  params.nsiphash = nsiphash;
+  params.trimstop = trimstop;
+  params.tailedges = tailedges;
+  params.nonces = nonces;
+  params.budgetmb = budgetmb;
+
+  SolverCtx* ctx = create_solver_ctx(&params);
+  if (!ctx) {
+    printf("No engine for cuckatoo%d", edgebits ? edgebits : DEFAULT_EDGEBITS);
+    if (xbits)
+      printf(" with %d xbits", xbits);
+    if (nsiphash)
+      printf(" with %d-way siphash", nsiphash);
+    printf(" runs on this cpu. available engines:");
+    for (u32 i = 0; i < NENGINES; i++)
+      printf(" %s", engines[i]->name);
+    printf("\n");
+    exit(1);
+  }
+  const solver_engine *engine = ctx->engine;
+
+  printf("Looking for %d-cycle on cuckatoo%d(\"%s\",%d", PROOFSIZE, engine->edgebits, header, nonce);
+  if (range > 1)
+    printf("-%d", nonce+range-1);
+  printf(") with 50%% edges\n");
+
+  u64 sbytes = engine->sharedbytes(ctx->ctx);
+  u64 tbytes = engine->threadbytes(ctx->ctx);
+  int sunit,tunit;
+  for (sunit=0; sbytes >= 10240; sbytes>>=10,sunit++) ;
+  for (tunit=0; tbytes >= 10240; tbytes>>=10,tunit++) ;
+  printf("Using engine %s with %d%cB bucket memory and %dx%d%cB thread memory,\n", engine->name, (int)sbytes, " KMGT"[sunit], params.nthreads, (int)tbytes, " KMGT"[tunit]);
+  printf("%d-way siphash, and %d buckets.\n", engine->nsiphash, 1 << engine->xbits);
+
+  run_solver(ctx, header, sizeof(header), nonce, range, NULL, NULL);
+
+  destroy_solver_ctx(ctx);
+}
+#endif
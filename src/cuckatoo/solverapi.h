@@ -0,0 +1,109 @@
+#pragma once
+// Cuck(at)oo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// the structs exchanged with solver callers, independent of EDGEBITS
+// so that differently configured solvers can share them
+
+#include <stdint.h> // for types uint32_t,uint64_t
+
+// save some keystrokes since i'm a lazy typer
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#ifndef MAX_SOLS
+#define MAX_SOLS 4
+#endif
+
+#ifndef PROOFSIZE
+// the next most important parameter is the (even) length
+// of the cycle to be found. a minimum of 12 is recommended
+#define PROOFSIZE 42
+#endif
+
+// Common Solver parameters, to return to caller
+struct SolverParams {
+	u32 nthreads = 0;
+	u32 ntrims = 0;
+	bool showcycle;
+	bool allrounds;
+	bool mutate_nonce = 1;
+	bool cpuload = 1;
+	bool pipeline = 0; // cpu mean: find cycles while trimming next nonce
+	u32 hugepages = 0; // cpu mean: 0 none, 1 transparent, 2 2MB, 3 1GB
+	bool numa = 0; // cpu mean: pin threads and place buckets near them
+	u32 trimstop = 0; // cpu mean: ntrims is a maximum; stop once a round removes under trimstop/1024 of edges
+	u32 tailedges = 0; // cpu mean: or once at most this many edges remain
+	const char *bucketdir = 0; // cpu mean: keep buckets in a file in this directory
+	u32 bucketmb = 0; // cpu mean: and move them to memory once they fit in this many MB
+	u32 nonces = 0; // cpu mean: trim up to this many nonces at once, on nthreads/nonces threads each
+	u32 budgetmb = 0; // cpu mean: but fewer if their memory would exceed this many MB
+
+	// cpu mean library: engine selection, 0 meaning default or best available
+	u32 edgebits = 0;
+	u32 xbits = 0;
+	u32 nsiphash = 0;
+
+	// Common cuda params
+	u32 device = 0;
+
+	// Cuda-lean specific params
+	u32 blocks = 0;
+	u32 tpb = 0;
+
+	// Cuda-mean specific params
+	u32 expand = 0;
+	u32 genablocks = 0;
+	u32 genatpb = 0;
+	u32 genbtpb = 0;
+	u32 trimtpb = 0;
+	u32 tailtpb = 0;
+	u32 recoverblocks = 0;
+	u32 recovertpb = 0;
+};
+
+// Solutions result structs to be instantiated by caller,
+// and filled by solver if desired
+struct Solution {
+ u64 id = 0;
+ u64 nonce = 0;
+ u64 proof[PROOFSIZE];
+};
+
+struct SolverSolutions {
+ u32 edge_bits = 0;
+ u32 num_sols = 0;
+ Solution sols[MAX_SOLS];
+};
+
+#define MAX_NAME_LEN 256
+
+// Solver statistics, to be instantiated by caller
+// and filled by solver if desired
+struct SolverStats {
+	u32 device_id = 0;
+	u32 edge_bits = 0;
+	char plugin_name[MAX_NAME_LEN]; // will be filled in caller-side
+	char device_name[MAX_NAME_LEN];
+	bool has_errored = false;
+	char error_reason[MAX_NAME_LEN];
+	u32 iterations = 0;
+	u64 last_start_time = 0;
+	u64 last_end_time = 0;
+	u64 last_solution_time = 0;
+};
+
+/////////////////////////////////////////////////////////////////
+// Declarations to make it easier for callers to link as required
+/////////////////////////////////////////////////////////////////
+
+#ifndef C_CALL_CONVENTION
+#define C_CALL_CONVENTION 0
+#endif
+
+// convention to prepend to called functions
+#if C_CALL_CONVENTION
+#define CALL_CONVENTION extern "C"
+#else
+#define CALL_CONVENTION
+#endif
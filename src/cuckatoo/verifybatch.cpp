@@ -0,0 +1,134 @@
+// Cuck(at)oo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// verify many proofs for one header and different nonces, as read from stdin
+// one per line as a decimal nonce followed by PROOFSIZE hexadecimal edges,
+// e.g. a solver's Solution lines with Solution replaced by the nonce
+
+#include "verifybatch.hpp"
+#include "../threads/pool.hpp"
+#include <inttypes.h> // for SCNx64 macro
+#include <stdio.h>    // printf/scanf
+#include <stdlib.h>   // exit
+#include <unistd.h>   // getopt
+#include <assert.h>   // d'uh
+#include <atomic>
+#include <vector>
+
+// arbitrary length of header hashed into siphash key
+#define HEADERLEN 246
+
+// number of proofs a thread claims at a time
+#define BATCHSIZE 64
+
+struct batch_ctx {
+  const char *header;
+  const u32 *nonces;
+  const word_t (*edges)[PROOFSIZE];
+  int *rcs;
+  u32 nproofs;
+  bool scalar;
+  std::atomic<u32> next;
+};
+
+void verifyworker(void *vp, const unsigned id) {
+  batch_ctx *bc = (batch_ctx *)vp;
+  char headernonce[HEADERLEN];
+  siphash_keys keys[BATCHSIZE];
+  memcpy(headernonce, bc->header, HEADERLEN);
+  for (u32 i; (i = bc->next.fetch_add(BATCHSIZE)) < bc->nproofs; ) {
+    const u32 n = std::min((u32)BATCHSIZE, bc->nproofs - i);
+    for (u32 j = 0; j < n; j++) {
+      ((u32 *)headernonce)[HEADERLEN/sizeof(u32)-1] = htole32(bc->nonces[i+j]); // place nonce near end aligned at u32
+      setheader(headernonce, sizeof(headernonce), &keys[j]);
+    }
+    if (bc->scalar) {
+      for (u32 j = 0; j < n; j++)
+        bc->rcs[i+j] = verify((word_t *)bc->edges[i+j], &keys[j]);
+    } else verify_batch(keys, bc->edges+i, bc->rcs+i, n);
+  }
+}
+
+int main(int argc, char **argv) {
+  char header[HEADERLEN];
+  memset(header, 0, HEADERLEN);
+  u32 nthreads = 1;
+  u32 nrepeats = 1;
+  bool scalar = false;
+  bool quiet = false;
+  u32 len;
+  int c;
+  while ((c = getopt (argc, argv, "h:qr:st:x:")) != -1) {
+    switch (c) {
+      case 'h':
+        len = strlen(optarg);
+        assert(len <= sizeof(header));
+        memcpy(header, optarg, len);
+        break;
+      case 'x':
+        len = strlen(optarg)/2;
+        assert(len == sizeof(header)-sizeof(u64) || len == sizeof(header));
+        for (u32 i=0; i<len; i++) {
+          sscanf(optarg+2*i, "%2hhx", header+i);
+        }
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'r':
+        nrepeats = atoi(optarg);
+        break;
+      case 's':
+        scalar = true;
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+    }
+  }
+  assert(nthreads >= 1 && nrepeats >= 1);
+
+  std::vector<u32> nonces;
+  std::vector<word_t> edges;
+  u32 nonce;
+  uint64_t index;
+  while (scanf(" %u", &nonce) == 1) {
+    nonces.push_back(nonce);
+    for (int n = 0; n < PROOFSIZE; n++) {
+      int nscan = scanf(" %" SCNx64, &index);
+      assert(nscan == 1);
+      edges.push_back(index);
+    }
+  }
+  const u32 nproofs = nonces.size();
+  std::vector<int> rcs(nproofs);
+
+  printf("Verifying %d size %d proofs for cuckatoo%d(\"%s\",nonce) with %d threads and siphash kernel %s\n",
+         nproofs, PROOFSIZE, EDGEBITS, header, nthreads, scalar ? "scalar" : siphash_dispatch->name);
+  batch_ctx bc;
+  bc.header = header;
+  bc.nonces = nonces.data();
+  bc.edges = (const word_t (*)[PROOFSIZE])edges.data();
+  bc.rcs = rcs.data();
+  bc.nproofs = nproofs;
+  bc.scalar = scalar;
+  thread_pool pool(nthreads);
+  u64 time0 = timestamp();
+  for (u32 r = 0; r < nrepeats; r++) {
+    bc.next = 0;
+    pool.run(verifyworker, &bc);
+  }
+  double secs = (timestamp() - time0) / 1e9;
+
+  u32 nok = 0;
+  for (u32 i = 0; i < nproofs; i++) {
+    nok += rcs[i] == POW_OK;
+    if (quiet) continue;
+    if (rcs[i] == POW_OK)
+      printf("%d Verified\n", nonces[i]);
+    else printf("%d FAILED due to %s\n", nonces[i], errstr[rcs[i]]);
+  }
+  printf("%d of %d proofs verified; %d verifications in %.3fs at %.0f proofs/sec\n",
+         nok, nproofs, nproofs*nrepeats, secs, nproofs*nrepeats / secs);
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Cuck(at)oo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2020 John Tromp
+
+// verification of many proofs at once, with the 2*PROOFSIZE endpoints of each
+// proof computed by the widest siphash24xN kernel the cpu supports
+
+#include "cuckatoo.h"
+#include "../crypto/siphashdispatch.h"
+
+// endpoints per proof, rounded up to a multiple of any kernel's lanes
+#define NPROOFHASHES ((2*PROOFSIZE + SIPHASH_MAXLANES-1) / SIPHASH_MAXLANES * SIPHASH_MAXLANES)
+
+// compute endpoints of proof edges for keys into uvs[2*PROOFSIZE]
+void proof_endpoints(const siphash_keys *keys, const word_t edges[PROOFSIZE], word_t *uvs) {
+  const siphash_kernel *sip = siphash_dispatch;
+  alignas(64) u64 indices[NPROOFHASHES];
+  alignas(64) u64 hashes[NPROOFHASHES];
+  for (u32 n = 0; n < PROOFSIZE; n++) {
+    indices[2*n  ] = 2*(u64)edges[n];
+    indices[2*n+1] = 2*(u64)edges[n] + 1;
+  }
+  for (u32 n = 2*PROOFSIZE; n < NPROOFHASHES; n++)
+    indices[n] = 0; // padding lanes
+  for (u32 n = 0; n < 2*PROOFSIZE; n += sip->nlanes)
+    sip->hash(keys, indices+n, hashes+n);
+  for (u32 n = 0; n < 2*PROOFSIZE; n++)
+    uvs[n] = hashes[n] & NODEMASK;
+}
+
+// verify nproofs proofs edges[i] against keys[i], leaving verify codes in rcs[i]
+void verify_batch(const siphash_keys *keys, const word_t (*edges)[PROOFSIZE], int *rcs, const u32 nproofs) {
+  word_t uvs[2*PROOFSIZE];
+  for (u32 i = 0; i < nproofs; i++) {
+    proof_endpoints(&keys[i], edges[i], uvs);
+    rcs[i] = verify_endpoints(edges[i], uvs);
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+// online cpus ordered by numa node, so that threads with consecutive ids,
+// which trim consecutive matrix rows and columns, share a node
+std::vector<int> numa_cpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  for (int node = 0; ; node++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (!f)
+      break;
+    int lo, hi;
+    while (fscanf(f, "%d", &lo) == 1) {
+      hi = lo;
+      if (fscanf(f, "-%d", &hi) != 1)
+        hi = lo;
+      for (int cpu = lo; cpu <= hi; cpu++)
+        cpus.push_back(cpu);
+      if (fgetc(f) != ',')
+        break;
+    }
+    fclose(f);
+  }
+#endif
+  if (cpus.empty()) { // no numa info
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < ncpus; cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// cpu for thread id out of nthreads, spreading threads evenly over nodes
+int thread_cpu(const std::vector<int> &cpus, const unsigned id, const unsigned nthreads) {
+  return cpus[(unsigned long long)id * cpus.size() / nthreads];
+}
+
+// pin calling thread to given cpu; returns false if not supported
+bool pin_thread(const int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
@@ -1,12 +1,18 @@
 #pragma once
 #include <pthread.h>
 #include <errno.h>
+#include <unistd.h>
+#include <atomic>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef __APPLE__
 typedef int pthread_barrierattr_t;
 #endif
 
-class trim_barrier {
+class mutex_barrier {
   pthread_mutex_t mutex;
   pthread_cond_t cond;
   unsigned limit;
@@ -14,17 +20,17 @@ class trim_barrier {
   int phase;
 
 public:
-  trim_barrier(unsigned int count) {
+  mutex_barrier(unsigned int count) {
     pthread_mutex_init(&mutex, 0);
     pthread_cond_init(&cond, 0);
     limit = count;
   }
-  
-  ~trim_barrier() {
+
+  ~mutex_barrier() {
     pthread_mutex_destroy(&mutex);
     pthread_cond_destroy(&cond);
   }
-  
+
   void clear() {
     count = phase = 0;
   }
@@ -34,7 +40,7 @@ public:
     phase = -1;
     pthread_mutex_unlock(&mutex);
   }
-  
+
   bool aborted() {
     return phase < 0;
   }
@@ -58,3 +64,96 @@ public:
       pthread_exit(NULL);
   }
 };
+
+#ifndef BARRIER_SPINS
+// how many times to poll the phase before sleeping in the kernel
+#define BARRIER_SPINS 1024
+#endif
+
+// sense reversing barrier, with the sense generalized to a phase counter
+// so that threads need no local state. waiters spin for a while, since
+// trimming threads tend to arrive close together, and then sleep on a futex.
+// count and phase live on separate cache lines, away from other data.
+class spin_barrier {
+  char pad0[64];
+  std::atomic<unsigned> count;
+  char pad1[64 - sizeof(std::atomic<unsigned>)];
+  std::atomic<int> phase; // -1 when aborted
+  std::atomic<unsigned> nsleepers;
+  char pad2[64 - sizeof(std::atomic<int>) - sizeof(std::atomic<unsigned>)];
+  unsigned limit;
+  unsigned spins;
+
+  static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  void sleepwhile(const int wait_phase) {
+#ifdef __linux__
+    nsleepers.fetch_add(1);
+    syscall(SYS_futex, (int *)&phase, FUTEX_WAIT_PRIVATE, wait_phase, NULL, NULL, 0);
+    nsleepers.fetch_sub(1);
+#else
+    sched_yield();
+#endif
+  }
+
+  void wakeall() {
+#ifdef __linux__
+    if (nsleepers.load()) // seq_cst pairs with increment before FUTEX_WAIT
+      syscall(SYS_futex, (int *)&phase, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0);
+#endif
+  }
+
+public:
+  spin_barrier(unsigned int count) {
+    limit = count;
+    // spinning only slows down threads that share a cpu with the ones we wait for
+    spins = count <= sysconf(_SC_NPROCESSORS_ONLN) ? BARRIER_SPINS : 0;
+    clear();
+  }
+
+  void clear() {
+    count.store(0, std::memory_order_relaxed);
+    phase.store(0, std::memory_order_relaxed);
+    nsleepers.store(0, std::memory_order_relaxed);
+  }
+
+  void abort() {
+    phase.store(-1);
+    wakeall();
+  }
+
+  bool aborted() {
+    return phase.load(std::memory_order_relaxed) < 0;
+  }
+
+  void wait() {
+    int wait_phase = phase.load(std::memory_order_acquire);
+    if (wait_phase < 0)
+      pthread_exit(NULL);
+    if (count.fetch_add(1, std::memory_order_acq_rel) + 1 >= limit) {
+      count.store(0, std::memory_order_relaxed);
+      // fails only if aborted meanwhile
+      phase.compare_exchange_strong(wait_phase, (wait_phase + 1) & 0x7fffffff);
+      wakeall();
+      return;
+    }
+    int now_phase;
+    for (unsigned i = 0; (now_phase = phase.load(std::memory_order_acquire)) == wait_phase; i++) {
+      if (i < spins)
+        pause();
+      else sleepwhile(wait_phase);
+    }
+    if (now_phase < 0)
+      pthread_exit(NULL);
+  }
+};
+
+#ifdef MUTEXBARRIER
+typedef mutex_barrier trim_barrier;
+#else
+typedef spin_barrier trim_barrier;
+#endif
@@ -0,0 +1,78 @@
+// micro-benchmark of trim_barrier implementations
+// reports average time per barrier crossing for 1 to 64 threads
+
+#include "barrier.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <chrono>
+
+typedef unsigned u32;
+typedef unsigned long long u64;
+
+u64 timestamp() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template <class barrier_t>
+struct bench_ctx {
+  barrier_t barry;
+  u32 nrounds;
+  bench_ctx(const u32 nthreads, const u32 n_rounds) : barry(nthreads) {
+    nrounds = n_rounds;
+    barry.clear();
+  }
+};
+
+template <class barrier_t>
+void *benchworker(void *vp) {
+  bench_ctx<barrier_t> *ctx = (bench_ctx<barrier_t> *)vp;
+  for (u32 r = 0; r < ctx->nrounds; r++)
+    ctx->barry.wait();
+  return 0;
+}
+
+// nanoseconds per barrier crossing
+template <class barrier_t>
+double bench(const u32 nthreads, const u32 nrounds) {
+  bench_ctx<barrier_t> ctx(nthreads, nrounds);
+  pthread_t *threads = new pthread_t[nthreads];
+  u64 time0 = timestamp();
+  for (u32 t = 0; t < nthreads; t++) {
+    int err = pthread_create(&threads[t], NULL, benchworker<barrier_t>, (void *)&ctx);
+    assert(err == 0);
+  }
+  for (u32 t = 0; t < nthreads; t++) {
+    int err = pthread_join(threads[t], NULL);
+    assert(err == 0);
+  }
+  u64 time1 = timestamp();
+  delete[] threads;
+  return (double)(time1 - time0) / nrounds;
+}
+
+int main(int argc, char **argv) {
+  u32 maxthreads = 64;
+  u32 nrounds = 10000;
+  int c;
+  while ((c = getopt (argc, argv, "n:t:")) != -1) {
+    switch (c) {
+      case 'n':
+        nrounds = atoi(optarg);
+        break;
+      case 't':
+        maxthreads = atoi(optarg);
+        break;
+    }
+  }
+  printf("%d barrier rounds on %ld cpus\n", nrounds, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("threads  mutex ns  spin ns  speedup\n");
+  for (u32 nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+    double mutexns = bench<mutex_barrier>(nthreads, nrounds);
+    double spinns  = bench<spin_barrier >(nthreads, nrounds);
+    printf("%7d %9.0f %8.0f %8.2f\n", nthreads, mutexns, spinns, mutexns / spinns);
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <pthread.h>
+#include <assert.h>
+
+// a fixed set of long-lived threads that repeatedly run one job on all threads,
+// parking on a condition variable in between jobs to avoid thread creation cost.
+// a job may end its thread with pthread_exit (as an aborted trim_barrier does),
+// in which case the thread is recreated at the start of the next job.
+class thread_pool {
+public:
+  typedef void (*job_t)(void *arg, const unsigned id);
+
+private:
+  struct worker {
+    unsigned id;
+    pthread_t thread;
+    thread_pool *pool;
+    unsigned seen;  // generation of last job taken
+    bool exited;
+  };
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  worker *workers;
+  job_t job;
+  void *arg;
+  unsigned generation;
+  unsigned nbusy;
+  bool quit;
+
+  static void exited(void *vp) {
+    worker *w = (worker *)vp;
+    thread_pool *p = w->pool;
+    pthread_mutex_lock(&p->mutex);
+    w->exited = true;
+    if (--p->nbusy == 0)
+      pthread_cond_signal(&p->done);
+    pthread_mutex_unlock(&p->mutex);
+  }
+
+  static void *main(void *vp) {
+    worker *w = (worker *)vp;
+    thread_pool *p = w->pool;
+    pthread_cleanup_push(exited, vp);
+    for (;;) {
+      pthread_mutex_lock(&p->mutex);
+      while (!p->quit && w->seen == p->generation)
+        pthread_cond_wait(&p->wake, &p->mutex);
+      if (p->quit) {
+        pthread_mutex_unlock(&p->mutex);
+        break;
+      }
+      w->seen = p->generation;
+      job_t j = p->job;
+      void *a = p->arg;
+      pthread_mutex_unlock(&p->mutex);
+      j(a, w->id);
+      pthread_mutex_lock(&p->mutex);
+      if (--p->nbusy == 0)
+        pthread_cond_signal(&p->done);
+      pthread_mutex_unlock(&p->mutex);
+    }
+    pthread_cleanup_pop(0);
+    return 0;
+  }
+
+  void spawn(worker *w) {
+    w->seen = generation;
+    w->exited = false;
+    int err = pthread_create(&w->thread, NULL, main, (void *)w);
+    assert(err == 0);
+  }
+
+public:
+  unsigned nthreads;
+
+  thread_pool(const unsigned n_threads) {
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&wake, 0);
+    pthread_cond_init(&done, 0);
+    nthreads = n_threads;
+    generation = nbusy = 0;
+    quit = false;
+    workers = new worker[nthreads];
+    for (unsigned t = 0; t < nthreads; t++) {
+      workers[t].id = t;
+      workers[t].pool = this;
+      spawn(&workers[t]);
+    }
+  }
+
+  ~thread_pool() {
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+    for (unsigned t = 0; t < nthreads; t++) {
+      int err = pthread_join(workers[t].thread, NULL);
+      assert(err == 0);
+    }
+    delete[] workers;
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&wake);
+    pthread_cond_destroy(&done);
+  }
+
+  // have every thread id run j(a, id) without waiting for them to finish
+  void start(job_t j, void *a) {
+    pthread_mutex_lock(&mutex);
+    assert(nbusy == 0);
+    for (unsigned t = 0; t < nthreads; t++) {
+      if (workers[t].exited) {
+        int err = pthread_join(workers[t].thread, NULL);
+        assert(err == 0);
+        spawn(&workers[t]);
+      }
+    }
+    job = j;
+    arg = a;
+    nbusy = nthreads;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  // wait for all threads to finish the last started job
+  void wait() {
+    pthread_mutex_lock(&mutex);
+    while (nbusy)
+      pthread_cond_wait(&done, &mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  // run j(a, id) for every thread id and wait for all of them to finish
+  void run(job_t j, void *a) {
+    start(j, a);
+    wait();
+  }
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+
+// bounded single-producer single-consumer ring of 2^LOGSIZE items, moved in batches
+// so that the shared indices are written once per batch. each side keeps a copy of
+// the other side's index, and only rereads it when the ring looks full or empty.
+// indices live on separate cache lines, away from the items.
+template <typename T, unsigned LOGSIZE>
+class spsc_queue {
+  static const unsigned SIZE = 1u << LOGSIZE;
+  static const unsigned MASK = SIZE - 1;
+
+  char pad0[64];
+  std::atomic<unsigned> head; // next item to take, written by consumer
+  unsigned tailcopy;          // consumer's copy of tail
+  char pad1[64 - sizeof(std::atomic<unsigned>) - sizeof(unsigned)];
+  std::atomic<unsigned> tail; // next free slot, written by producer
+  unsigned headcopy;          // producer's copy of head
+  char pad2[64 - sizeof(std::atomic<unsigned>) - sizeof(unsigned)];
+  T items[SIZE];
+
+public:
+  spsc_queue() : head(0), tailcopy(0), tail(0), headcopy(0) { }
+
+  // append all n items, or none if they don't fit
+  bool push(const T *src, const unsigned n) {
+    const unsigned t = tail.load(std::memory_order_relaxed);
+    if (t + n - headcopy > SIZE) {
+      headcopy = head.load(std::memory_order_acquire);
+      if (t + n - headcopy > SIZE)
+        return false;
+    }
+    for (unsigned i = 0; i < n; i++)
+      items[(t + i) & MASK] = src[i];
+    tail.store(t + n, std::memory_order_release);
+    return true;
+  }
+
+  // call f(items, n) on the queued items, in at most two contiguous spans,
+  // and remove them, returning their number
+  template <typename F>
+  unsigned drain(F f) {
+    const unsigned h = head.load(std::memory_order_relaxed);
+    if (h == tailcopy) {
+      tailcopy = tail.load(std::memory_order_acquire);
+      if (h == tailcopy)
+        return 0;
+    }
+    const unsigned t = tailcopy;
+    const unsigned n = t - h, n0 = SIZE - (h & MASK);
+    if (n <= n0)
+      f(items + (h & MASK), n);
+    else {
+      f(items + (h & MASK), n0);
+      f(items, n - n0);
+    }
+    head.store(t, std::memory_order_release);
+    return n;
+  }
+};